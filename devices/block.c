@@ -4,6 +4,9 @@
 #include <stdio.h>
 #include "devices/ide.h"
 #include "threads/malloc.h"
+#ifdef FILESYS
+#include "filesys/cache.h"
+#endif
 
 /* A block device. */
 struct block
@@ -176,6 +179,9 @@ block_print_stats (void)
                   block->read_cnt, block->write_cnt);
         }
     }
+#ifdef FILESYS
+  cache_print_stats ();
+#endif
 }
 
 /* Registers a new block device with the given NAME.  If
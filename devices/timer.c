@@ -1,6 +1,7 @@
 #include "devices/timer.h"
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stdio.h>
 #include "devices/pit.h"
@@ -24,7 +25,21 @@ static int64_t ticks;
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/* A thread blocked in timer_sema_down(). */
+struct sleeper
+  {
+    struct list_elem elem;      /* Element in sleepers. */
+    struct thread *thread;      /* The blocked thread. */
+    int64_t wakeup;             /* Tick to give up waiting at. */
+    bool timed_out;             /* Removed from sleepers by the timer? */
+  };
+
+/* Threads blocked in timer_sema_down(), in order of wakeup.
+   Protected by disabling interrupts. */
+static struct list sleepers;
+
 static intr_handler_func timer_interrupt;
+static list_less_func sleeper_less;
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
@@ -36,6 +51,7 @@ void
 timer_init (void) 
 {
   pit_configure_channel (0, 2, TIMER_FREQ);
+  list_init (&sleepers);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
 
@@ -89,11 +105,47 @@ timer_elapsed (int64_t then)
 void
 timer_sleep (int64_t ticks) 
 {
-  int64_t start = timer_ticks ();
+  struct semaphore sema;
 
   ASSERT (intr_get_level () == INTR_ON);
-  while (timer_elapsed (start) < ticks) 
-    thread_yield ();
+  sema_init (&sema, 0);
+  timer_sema_down (&sema, ticks);
+}
+
+/* Like sema_down(), but gives up once TIMEOUT timer ticks have
+   passed.  Returns true if SEMA was decremented, false if the
+   wait timed out.  Blocks instead of polling, so the thread
+   uses no CPU while it waits. */
+bool
+timer_sema_down (struct semaphore *sema, int64_t timeout) 
+{
+  struct sleeper s;
+  enum intr_level old_level;
+  bool success;
+
+  ASSERT (sema != NULL);
+  ASSERT (!intr_context ());
+
+  old_level = intr_disable ();
+  s.thread = thread_current ();
+  s.wakeup = ticks + timeout;
+  while (sema->value == 0 && ticks < s.wakeup) 
+    {
+      s.timed_out = false;
+      list_insert_ordered (&sleepers, &s.elem, sleeper_less, NULL);
+      list_push_back (&sema->waiters, &s.thread->elem);
+      thread_block ();
+
+      /* Woken by sema_up(), which took us off SEMA's waiters but
+         not off sleepers. */
+      if (!s.timed_out)
+        list_remove (&s.elem);
+    }
+  success = sema->value > 0;
+  if (success)
+    sema->value--;
+  intr_set_level (old_level);
+  return success;
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -172,6 +224,34 @@ timer_interrupt (struct intr_frame *args UNUSED)
 {
   ticks++;
   thread_tick ();
+
+  /* Wake up sleepers whose time is up.  One that sema_up() has
+     already unblocked is just dropped from the list. */
+  while (!list_empty (&sleepers)) 
+    {
+      struct sleeper *s = list_entry (list_front (&sleepers),
+                                      struct sleeper, elem);
+      if (s->wakeup > ticks)
+        break;
+      list_pop_front (&sleepers);
+      s->timed_out = true;
+      if (s->thread->status == THREAD_BLOCKED) 
+        {
+          list_remove (&s->thread->elem);
+          thread_unblock (s->thread);
+        }
+    }
+}
+
+/* Orders sleepers by wakeup tick. */
+static bool
+sleeper_less (const struct list_elem *a_, const struct list_elem *b_,
+              void *aux UNUSED) 
+{
+  const struct sleeper *a = list_entry (a_, struct sleeper, elem);
+  const struct sleeper *b = list_entry (b_, struct sleeper, elem);
+
+  return a->wakeup < b->wakeup;
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
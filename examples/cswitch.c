@@ -0,0 +1,89 @@
+/* cswitch.c
+
+   Context-switch microbenchmark.
+
+   Starts several copies of itself that run side by side, each
+   repeatedly touching a small working set of user pages and
+   entering the kernel through a cheap system call.  The copies
+   are preempted by the timer, so the CPU keeps switching
+   between address spaces.  Compare the "Thread:" tick counts
+   and the "Paging:" counters that the kernel prints at shutdown
+   to see what each switch costs in TLB refills. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+
+/* Default number of processes to run at once. */
+#define CHILDREN 4
+
+/* Default number of rounds each process runs. */
+#define ROUNDS 20000
+
+/* Size of each process's working set, in 4 kB pages. */
+#define WS_PAGES 16
+
+/* Working set.  Static to reduce stack usage. */
+static char ws[WS_PAGES][4096];
+
+/* Runs ROUNDS rounds of the benchmark loop and returns a
+   checksum, so that the compiler can't drop the loop. */
+static int
+run (int rounds)
+{
+  int sum = 0;
+  int i, j;
+
+  for (i = 0; i < rounds; i++)
+    {
+      for (j = 0; j < WS_PAGES; j++)
+        sum += ws[j][(i * 64) % 4096]++;
+      sum += filesize (-1);
+    }
+  return sum;
+}
+
+int
+main (int argc, char *argv[])
+{
+  char cmd[64];
+  pid_t pids[64];
+  int children = CHILDREN;
+  int rounds = ROUNDS;
+  int i;
+
+  if (argc == 3 && !strcmp (argv[1], "-c"))
+    {
+      /* Child: run the loop and quit. */
+      run (atoi (argv[2]));
+      return EXIT_SUCCESS;
+    }
+
+  if (argc > 1)
+    children = atoi (argv[1]);
+  if (argc > 2)
+    rounds = atoi (argv[2]);
+  if (argc > 3 || children < 1 || children > 64 || rounds < 1)
+    {
+      printf ("usage: cswitch [children] [rounds]\n");
+      return EXIT_FAILURE;
+    }
+
+  printf ("cswitch: %d processes, %d rounds each\n", children, rounds);
+  snprintf (cmd, sizeof cmd, "cswitch -c %d", rounds);
+  for (i = 0; i < children; i++)
+    {
+      pids[i] = exec (cmd);
+      if (pids[i] == PID_ERROR)
+        {
+          printf ("cswitch: exec failed\n");
+          children = i;
+          break;
+        }
+    }
+  for (i = 0; i < children; i++)
+    wait (pids[i]);
+  printf ("cswitch: done\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,50 @@
+/* pstat.c
+
+   Prints the memory statistics of every running process, one
+   line each, as a snapshot in the style of "top".  If a command
+   line is given, it is started first, so that it shows up in
+   the table, and then waited for.  Counts are in pages. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+
+int
+main (int argc, char *argv[])
+{
+  char cmd[128];
+  struct procstat st;
+  pid_t child = PID_ERROR;
+  pid_t pid;
+  int i;
+
+  if (argc > 1)
+    {
+      cmd[0] = '\0';
+      for (i = 1; i < argc; i++)
+        {
+          if (i > 1)
+            strlcat (cmd, " ", sizeof cmd);
+          strlcat (cmd, argv[i], sizeof cmd);
+        }
+      child = exec (cmd);
+      if (child == PID_ERROR)
+        {
+          printf ("pstat: exec failed\n");
+          return EXIT_FAILURE;
+        }
+    }
+
+  printf ("%5s %-15s %8s %8s %6s %6s %6s %6s %6s %6s\n",
+          "PID", "NAME", "MINFLT", "MAJFLT", "SWPIN", "SWPOUT",
+          "SWAP", "RSS", "PEAK", "MMAP");
+  for (pid = 0; (pid = procstat (pid, &st)) != PID_ERROR; pid++)
+    printf ("%5d %-15s %8u %8u %6u %6u %6u %6u %6u %6u\n",
+            st.pid, st.name, st.minor_faults, st.major_faults,
+            st.swap_ins, st.swap_outs, st.swap_pages, st.rss,
+            st.peak_rss, st.mmap_rss);
+
+  if (child != PID_ERROR)
+    wait (child);
+  return EXIT_SUCCESS;
+}
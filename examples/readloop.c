@@ -0,0 +1,61 @@
+/* readloop.c
+
+   Kernel copy microbenchmark.
+
+   Reads a file over and over into a large user buffer, so that
+   almost all of the time is spent in the kernel copying file
+   data through inode_read_at() and the system call layer.  The
+   copies touch every page of the buffer cache and of the user
+   buffer, which makes the benchmark sensitive to how many TLB
+   entries the kernel's own mapping needs.  Run it once normally
+   and once with the "-nopse" kernel option and compare the
+   "Thread:" kernel tick counts printed at shutdown. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+
+/* Default number of passes over the file. */
+#define PASSES 200
+
+/* Size of the user buffer, in bytes. */
+#define BUF_SIZE (64 * 1024)
+
+/* Buffer.  Static to reduce stack usage. */
+static char buf[BUF_SIZE];
+
+int
+main (int argc, char *argv[])
+{
+  int passes = PASSES;
+  long long total = 0;
+  int fd, i;
+
+  if (argc < 2 || argc > 3)
+    {
+      printf ("usage: readloop file [passes]\n");
+      return EXIT_FAILURE;
+    }
+  if (argc > 2)
+    passes = atoi (argv[2]);
+
+  fd = open (argv[1]);
+  if (fd < 0)
+    {
+      printf ("%s: open failed\n", argv[1]);
+      return EXIT_FAILURE;
+    }
+
+  for (i = 0; i < passes; i++)
+    {
+      int bytes_read;
+
+      seek (fd, 0);
+      while ((bytes_read = read (fd, buf, sizeof buf)) > 0)
+        total += bytes_read;
+    }
+  close (fd);
+
+  printf ("readloop: %d passes, %lld bytes\n", passes, total);
+  return EXIT_SUCCESS;
+}
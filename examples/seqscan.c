@@ -0,0 +1,69 @@
+/* seqscan.c
+
+   madvise() benchmark.
+
+   Maps a file into memory, gives the kernel the advice named on
+   the command line about the mapping, and then reads the whole
+   mapping from start to end.  Run it with each kind of advice
+   and compare the page fault count and the "Fault-around:" and
+   "madvise:" lines that the kernel prints at shutdown. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+
+/* Where to map the file. */
+#define MAP_ADDR ((char *) 0x10000000)
+
+int
+main (int argc, char *argv[])
+{
+  static const char *advice_names[] =
+    {"normal", "random", "sequential", "willneed"};
+  int advice = MADV_NORMAL;
+  unsigned sum = 0;
+  mapid_t map;
+  int fd, size, i;
+
+  if (argc < 2 || argc > 3)
+    {
+      printf ("usage: seqscan file [normal|random|sequential|willneed]\n");
+      return EXIT_FAILURE;
+    }
+  if (argc > 2)
+    {
+      for (advice = 0; advice < 4; advice++)
+        if (!strcmp (argv[2], advice_names[advice]))
+          break;
+      if (advice == 4)
+        {
+          printf ("seqscan: unknown advice `%s'\n", argv[2]);
+          return EXIT_FAILURE;
+        }
+    }
+
+  fd = open (argv[1]);
+  if (fd < 0)
+    {
+      printf ("%s: open failed\n", argv[1]);
+      return EXIT_FAILURE;
+    }
+  size = filesize (fd);
+  map = mmap (fd, MAP_ADDR);
+  if (map == MAP_FAILED)
+    {
+      printf ("%s: mmap failed\n", argv[1]);
+      return EXIT_FAILURE;
+    }
+
+  if (madvise (MAP_ADDR, size, advice) < 0)
+    printf ("seqscan: madvise failed\n");
+  for (i = 0; i < size; i++)
+    sum += MAP_ADDR[i];
+
+  munmap (map);
+  close (fd);
+  printf ("seqscan: %d bytes, advice %s, checksum %u\n",
+          size, advice_names[advice], sum);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,531 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <hash.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Buffer cache.
+
+   Keeps the CACHE_SIZE most useful sectors of the file system
+   device in memory.  Writes go to the cache and reach the disk
+   when their sector is evicted, when the flusher thread writes
+   them behind, or when the cache is flushed.  The flusher wakes
+   up every FLUSH_PERIOD ticks to write back the sectors dirty
+   for longer than DIRTY_AGE ticks, and right away to write back
+   every dirty sector once more than DIRTY_HIGH are dirty.
+   Sectors are always written back in order of sector number, to
+   keep the disk head moving one way.
+
+   A hash table indexes the cached sectors by sector number.
+   When a sector that is not cached is needed, the clock
+   algorithm picks an entry to reuse, giving each recently used
+   entry a second chance.
+
+   cache_lock protects the index and the bookkeeping of every
+   entry, but not the data: each entry has a lock of its own,
+   held while its sector is read from or written to disk and
+   while a caller copies data in or out, so that unrelated
+   sectors can be used at the same time.  An entry is never
+   reused while any thread holds or waits for its lock, which
+   cache_get() and cache_put() track in `users'.  A thread that
+   waited for an entry must check that it still holds the sector
+   it wanted, because its previous owner may have reused it.
+
+   Sectors that a sequential reader will want soon can be queued
+   with cache_read_ahead() for the read-ahead thread to bring in.
+   The entry of a sector being read is indexed and locked for the
+   whole read, so a reader that wants the sector meanwhile waits
+   for that read instead of issuing its own. */
+
+/* Number of sectors cached. */
+#define CACHE_SIZE 64
+
+/* Write-behind thresholds. */
+#define FLUSH_PERIOD (TIMER_FREQ / 2)   /* Ticks between flushes. */
+#define DIRTY_AGE (TIMER_FREQ * 2)      /* Ticks a sector may stay dirty. */
+#define DIRTY_HIGH (CACHE_SIZE / 2)     /* Dirty sectors to flush at once. */
+
+/* A cached sector. */
+struct cache_entry
+  {
+    struct hash_elem hash_elem; /* Element in `cache_index'. */
+    block_sector_t sector;      /* Sector cached, if in `cache_index'. */
+    bool indexed;               /* In `cache_index'? */
+    int users;                  /* Threads holding or awaiting `lock'. */
+    bool accessed;              /* Used since the clock hand passed? */
+
+    /* Protected by `lock'. */
+    struct lock lock;           /* Serializes use of the data. */
+    bool valid;                 /* Does `data' hold `sector'? */
+    bool dirty;                 /* Modified since read or written? */
+    int64_t dirty_since;        /* Tick when it became dirty. */
+    bool read_ahead;            /* Read ahead, not yet used? */
+    uint8_t *data;              /* BLOCK_SECTOR_SIZE bytes. */
+  };
+
+static struct cache_entry cache[CACHE_SIZE];
+static struct hash cache_index;         /* Cached sectors. */
+static struct lock cache_lock;          /* Protects the above. */
+static struct condition entry_free;     /* Signaled when users drops to 0. */
+static size_t hand;                     /* Clock hand. */
+static size_t dirty_cnt;                /* Number of dirty entries. */
+static struct semaphore flush_now;      /* Upped when too many are dirty. */
+
+/* Read-ahead queue, a ring of sectors to bring in.  Requests that
+   don't fit are dropped, since read-ahead is only a hint. */
+#define RA_QUEUE_SIZE 32
+static block_sector_t ra_queue[RA_QUEUE_SIZE];
+static size_t ra_head;                  /* Next sector to read. */
+static size_t ra_cnt;                   /* Number of sectors queued. */
+static struct lock ra_lock;             /* Protects the queue. */
+static struct condition ra_ready;       /* Signaled when a sector is queued. */
+
+/* Statistics. */
+static long long hit_cnt;               /* # of accesses to cached sectors. */
+static long long miss_cnt;              /* # that had to be read in. */
+static long long writeback_cnt;         /* # of dirty sectors written. */
+static long long ra_read_cnt;           /* # of sectors read ahead. */
+static long long ra_used_cnt;           /* # of those accessed later. */
+static long long ra_drop_cnt;           /* # of requests dropped. */
+static long long flush_wakeups;         /* # of times the flusher ran. */
+static long long flush_aged_cnt;        /* # of sectors it wrote for age. */
+static long long flush_full_cnt;        /* # it wrote for DIRTY_HIGH. */
+
+static hash_hash_func entry_hash;
+static hash_less_func entry_less;
+static struct cache_entry *cache_get (block_sector_t, bool read,
+                                      bool read_ahead);
+static void cache_put (struct cache_entry *, bool dirty);
+static struct cache_entry *lookup (block_sector_t);
+static struct cache_entry *pick_victim (void);
+static size_t flush (cache_filter *, void *aux, int64_t dirtied_before);
+static thread_func read_ahead_thread NO_RETURN;
+static thread_func flusher_thread NO_RETURN;
+
+/* Initializes the buffer cache. */
+void
+cache_init (void)
+{
+  uint8_t *data;
+  size_t i;
+
+  data = palloc_get_multiple (PAL_ASSERT,
+                              CACHE_SIZE * BLOCK_SECTOR_SIZE / PGSIZE);
+  lock_init (&cache_lock);
+  cond_init (&entry_free);
+  sema_init (&flush_now, 0);
+  hash_init (&cache_index, entry_hash, entry_less, NULL);
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[i];
+
+      e->indexed = false;
+      e->users = 0;
+      e->accessed = false;
+      lock_init (&e->lock);
+      e->valid = false;
+      e->dirty = false;
+      e->dirty_since = 0;
+      e->read_ahead = false;
+      e->data = data + i * BLOCK_SECTOR_SIZE;
+    }
+
+  lock_init (&ra_lock);
+  cond_init (&ra_ready);
+  thread_create ("read-ahead", PRI_DEFAULT, read_ahead_thread, NULL);
+  thread_create ("flusher", PRI_DEFAULT, flusher_thread, NULL);
+}
+
+/* Copies SIZE bytes starting at byte OFS within SECTOR into
+   BUFFER. */
+void
+cache_read (block_sector_t sector, void *buffer, int ofs, int size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = cache_get (sector, true, false);
+  memcpy (buffer, e->data + ofs, size);
+  cache_put (e, false);
+}
+
+/* Copies SIZE bytes from BUFFER into SECTOR, starting at byte
+   OFS within it.  The sector is only read from disk first if the
+   write does not cover all of it. */
+void
+cache_write (block_sector_t sector, const void *buffer, int ofs, int size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = cache_get (sector, size < BLOCK_SECTOR_SIZE, false);
+  memcpy (e->data + ofs, buffer, size);
+  e->valid = true;
+  cache_put (e, true);
+}
+
+/* Queues SECTOR to be brought into the cache in the background,
+   unless it is already there. */
+void
+cache_read_ahead (block_sector_t sector)
+{
+  bool cached;
+
+  lock_acquire (&cache_lock);
+  cached = lookup (sector) != NULL;
+  lock_release (&cache_lock);
+  if (cached)
+    return;
+
+  lock_acquire (&ra_lock);
+  if (ra_cnt < RA_QUEUE_SIZE)
+    {
+      ra_queue[(ra_head + ra_cnt++) % RA_QUEUE_SIZE] = sector;
+      cond_signal (&ra_ready, &ra_lock);
+    }
+  else
+    ra_drop_cnt++;
+  lock_release (&ra_lock);
+}
+
+/* Writes every dirty sector in the cache to disk. */
+void
+cache_flush (void)
+{
+  flush (NULL, NULL, INT64_MAX);
+}
+
+/* Writes to disk every dirty sector in the cache for which
+   FILTER returns true, given AUX. */
+void
+cache_flush_if (cache_filter *filter, void *aux)
+{
+  flush (filter, aux, INT64_MAX);
+}
+
+/* Prints buffer cache statistics. */
+void
+cache_print_stats (void)
+{
+  long long total = hit_cnt + miss_cnt;
+
+  printf ("Cache: %d sectors, %lld hits, %lld misses (%lld%% hits), "
+          "%lld write-backs\n",
+          CACHE_SIZE, hit_cnt, miss_cnt,
+          total > 0 ? hit_cnt * 100 / total : 0, writeback_cnt);
+  printf ("Cache: %lld sectors read ahead, %lld used, "
+          "%lld requests dropped\n",
+          ra_read_cnt, ra_used_cnt, ra_drop_cnt);
+  printf ("Cache: flusher ran %lld times, wrote %lld sectors for age, "
+          "%lld with over %d dirty\n",
+          flush_wakeups, flush_aged_cnt, flush_full_cnt, DIRTY_HIGH);
+}
+
+/* Flusher thread.  See the comment at the top of this file. */
+static void
+flusher_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      /* Sleep, but wake up early if cache_put() finds too many
+         sectors dirty. */
+      bool full = timer_sema_down (&flush_now, FLUSH_PERIOD);
+
+      flush_wakeups++;
+      if (full)
+        flush_full_cnt += flush (NULL, NULL, INT64_MAX);
+      else
+        flush_aged_cnt += flush (NULL, NULL, timer_ticks () - DIRTY_AGE);
+    }
+}
+
+/* Compares the sectors of the entries that A_ and B_ point to,
+   for qsort(). */
+static int
+compare_sectors (const void *a_, const void *b_)
+{
+  const struct cache_entry *a = *(struct cache_entry *const *) a_;
+  const struct cache_entry *b = *(struct cache_entry *const *) b_;
+
+  return a->sector < b->sector ? -1 : a->sector > b->sector;
+}
+
+/* Writes back the dirty entries that became dirty before tick
+   DIRTIED_BEFORE and for whose sectors FILTER returns true, given
+   AUX, or all of them if FILTER is null, in order of sector
+   number.  Returns the number of sectors written. */
+static size_t
+flush (cache_filter *filter, void *aux, int64_t dirtied_before)
+{
+  struct cache_entry *batch[CACHE_SIZE];
+  size_t cnt = 0;
+  size_t written = 0;
+  size_t i;
+
+  /* Keep the entries from being reused while we work.  The dirty
+     bits read here are only a hint; they are checked again under
+     each entry's lock. */
+  lock_acquire (&cache_lock);
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[i];
+
+      if (e->indexed && e->dirty && e->dirty_since < dirtied_before
+          && (filter == NULL || filter (e->sector, aux)))
+        {
+          e->users++;
+          batch[cnt++] = e;
+        }
+    }
+  lock_release (&cache_lock);
+
+  qsort (batch, cnt, sizeof *batch, compare_sectors);
+  for (i = 0; i < cnt; i++)
+    {
+      struct cache_entry *e = batch[i];
+      bool wrote = false;
+
+      lock_acquire (&e->lock);
+      if (e->valid && e->dirty)
+        {
+          block_write (fs_device, e->sector, e->data);
+          e->dirty = false;
+          wrote = true;
+        }
+      lock_release (&e->lock);
+
+      lock_acquire (&cache_lock);
+      if (wrote)
+        {
+          dirty_cnt--;
+          writeback_cnt++;
+          written++;
+        }
+      if (--e->users == 0)
+        cond_signal (&entry_free, &cache_lock);
+      lock_release (&cache_lock);
+    }
+  return written;
+}
+
+/* Read-ahead thread.  Brings in the sectors queued by
+   cache_read_ahead(), in order. */
+static void
+read_ahead_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      struct cache_entry *e;
+      block_sector_t sector;
+
+      lock_acquire (&ra_lock);
+      while (ra_cnt == 0)
+        cond_wait (&ra_ready, &ra_lock);
+      sector = ra_queue[ra_head];
+      ra_head = (ra_head + 1) % RA_QUEUE_SIZE;
+      ra_cnt--;
+      lock_release (&ra_lock);
+
+      e = cache_get (sector, true, true);
+      if (e != NULL)
+        cache_put (e, false);
+    }
+}
+
+/* Returns the entry for SECTOR, with its lock held, bringing the
+   sector into the cache if it is not there.  If READ is false,
+   the caller is about to overwrite the whole sector, so it is
+   not read from disk and the data must be treated as garbage.
+   The caller must call cache_put() when done.
+
+   If READ_AHEAD is true, the sector is being read ahead: returns
+   a null pointer at once if it is already cached, and otherwise
+   leaves the entry marked so that cache_put() does not count it
+   as used. */
+static struct cache_entry *
+cache_get (block_sector_t sector, bool read, bool read_ahead)
+{
+  for (;;)
+    {
+      struct cache_entry *e;
+      block_sector_t old_sector;
+
+      lock_acquire (&cache_lock);
+      e = lookup (sector);
+      if (e != NULL && read_ahead)
+        {
+          lock_release (&cache_lock);
+          return NULL;
+        }
+      if (e != NULL)
+        {
+          e->users++;
+          lock_release (&cache_lock);
+
+          lock_acquire (&e->lock);
+          if (e->indexed && e->sector == sector)
+            {
+              hit_cnt++;
+              if (e->read_ahead)
+                {
+                  e->read_ahead = false;
+                  ra_used_cnt++;
+                }
+              if (!e->valid && read)
+                {
+                  block_read (fs_device, sector, e->data);
+                  e->valid = true;
+                }
+              return e;
+            }
+
+          /* Reused for another sector while we waited. */
+          cache_put (e, false);
+          continue;
+        }
+
+      e = pick_victim ();
+      if (e == NULL)
+        {
+          /* Every entry is in use.  Wait for one to be let go. */
+          cond_wait (&entry_free, &cache_lock);
+          lock_release (&cache_lock);
+          continue;
+        }
+      e->users++;
+      lock_acquire (&e->lock);
+
+      if (e->valid && e->dirty)
+        {
+          /* Write back the old sector before giving up the entry.
+             It stays in the index meanwhile, so that nobody reads
+             a stale copy of it from disk. */
+          old_sector = e->sector;
+          lock_release (&cache_lock);
+          block_write (fs_device, old_sector, e->data);
+          e->dirty = false;
+          lock_acquire (&cache_lock);
+          dirty_cnt--;
+          writeback_cnt++;
+
+          /* Someone else may have brought in SECTOR meanwhile. */
+          if (lookup (sector) != NULL)
+            {
+              lock_release (&cache_lock);
+              cache_put (e, false);
+              continue;
+            }
+        }
+
+      if (e->indexed)
+        hash_delete (&cache_index, &e->hash_elem);
+      e->sector = sector;
+      e->indexed = true;
+      e->valid = false;
+      e->read_ahead = read_ahead;
+      hash_insert (&cache_index, &e->hash_elem);
+      if (read_ahead)
+        ra_read_cnt++;
+      else
+        miss_cnt++;
+      lock_release (&cache_lock);
+
+      if (read)
+        {
+          block_read (fs_device, sector, e->data);
+          e->valid = true;
+        }
+      return e;
+    }
+}
+
+/* Releases entry E, obtained from cache_get(), marking it dirty
+   if DIRTY is true. */
+static void
+cache_put (struct cache_entry *e, bool dirty)
+{
+  bool used = !e->read_ahead;
+  bool newly_dirty = dirty && !e->dirty;
+
+  if (newly_dirty)
+    {
+      e->dirty = true;
+      e->dirty_since = timer_ticks ();
+    }
+  lock_release (&e->lock);
+
+  lock_acquire (&cache_lock);
+  if (used)
+    e->accessed = true;
+  if (newly_dirty && ++dirty_cnt == DIRTY_HIGH + 1)
+    sema_up (&flush_now);
+  if (--e->users == 0)
+    cond_signal (&entry_free, &cache_lock);
+  lock_release (&cache_lock);
+}
+
+/* Returns the entry in the index for SECTOR, or a null pointer
+   if there is none.  Must be called with cache_lock held. */
+static struct cache_entry *
+lookup (block_sector_t sector)
+{
+  struct cache_entry key;
+  struct hash_elem *e;
+
+  key.sector = sector;
+  e = hash_find (&cache_index, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct cache_entry, hash_elem) : NULL;
+}
+
+/* Chooses an entry to reuse with the clock algorithm, skipping
+   entries in use, and returns it, or a null pointer if every
+   entry is in use.  Must be called with cache_lock held. */
+static struct cache_entry *
+pick_victim (void)
+{
+  size_t i;
+
+  for (i = 0; i < 2 * CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[hand];
+
+      hand = (hand + 1) % CACHE_SIZE;
+      if (e->users > 0)
+        continue;
+      if (e->accessed)
+        {
+          e->accessed = false;
+          continue;
+        }
+      return e;
+    }
+  return NULL;
+}
+
+/* Returns a hash value for entry E. */
+static unsigned
+entry_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct cache_entry *c = hash_entry (e, struct cache_entry, hash_elem);
+  return hash_int (c->sector);
+}
+
+/* Returns true if entry A's sector precedes entry B's. */
+static bool
+entry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct cache_entry *a = hash_entry (a_, struct cache_entry, hash_elem);
+  const struct cache_entry *b = hash_entry (b_, struct cache_entry, hash_elem);
+
+  return a->sector < b->sector;
+}
@@ -0,0 +1,18 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+/* Selects sectors for cache_flush_if(). */
+typedef bool cache_filter (block_sector_t, void *aux);
+
+void cache_init (void);
+void cache_read (block_sector_t, void *buffer, int ofs, int size);
+void cache_write (block_sector_t, const void *buffer, int ofs, int size);
+void cache_read_ahead (block_sector_t);
+void cache_flush (void);
+void cache_flush_if (cache_filter *, void *aux);
+void cache_print_stats (void);
+
+#endif /* filesys/cache.h */
@@ -9,8 +9,22 @@ struct file
     struct inode *inode;        /* File's inode. */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
+
+    /* Sequential read detection, for read-ahead. */
+    off_t ra_next;              /* Offset just past the last read. */
+    unsigned ra_run;            /* Sequential reads in a row. */
+    off_t ra_end;               /* End of the data read ahead. */
   };
 
+/* Read-ahead window, in bytes.  It starts at RA_MIN on the first
+   sequential read and doubles on each one after that, up to
+   RA_MAX, which is kept well below the size of the buffer
+   cache. */
+#define RA_MIN (2 * BLOCK_SECTOR_SIZE)
+#define RA_MAX (16 * BLOCK_SECTOR_SIZE)
+
+static void read_ahead (struct file *, off_t ofs, off_t bytes_read);
+
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
    allocation fails or if INODE is null. */
@@ -69,6 +83,7 @@ off_t
 file_read (struct file *file, void *buffer, off_t size) 
 {
   off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+  read_ahead (file, file->pos, bytes_read);
   file->pos += bytes_read;
   return bytes_read;
 }
@@ -81,15 +96,16 @@ file_read (struct file *file, void *buffer, off_t size)
 off_t
 file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) 
 {
-  return inode_read_at (file->inode, buffer, size, file_ofs);
+  off_t bytes_read = inode_read_at (file->inode, buffer, size, file_ofs);
+  read_ahead (file, file_ofs, bytes_read);
+  return bytes_read;
 }
 
 /* Writes SIZE bytes from BUFFER into FILE,
    starting at the file's current position.
    Returns the number of bytes actually written,
-   which may be less than SIZE if end of file is reached.
-   (Normally we'd grow the file in that case, but file growth is
-   not yet implemented.)
+   which may be less than SIZE if the disk fills up.
+   Writing past end of file grows the file.
    Advances FILE's position by the number of bytes read. */
 off_t
 file_write (struct file *file, const void *buffer, off_t size) 
@@ -102,9 +118,8 @@ file_write (struct file *file, const void *buffer, off_t size)
 /* Writes SIZE bytes from BUFFER into FILE,
    starting at offset FILE_OFS in the file.
    Returns the number of bytes actually written,
-   which may be less than SIZE if end of file is reached.
-   (Normally we'd grow the file in that case, but file growth is
-   not yet implemented.)
+   which may be less than SIZE if the disk fills up.
+   Writing past end of file grows the file.
    The file's current position is unaffected. */
 off_t
 file_write_at (struct file *file, const void *buffer, off_t size,
@@ -166,3 +181,39 @@ file_tell (struct file *file)
   ASSERT (file != NULL);
   return file->pos;
 }
+
+/* Notes that BYTES_READ bytes were just read from FILE at offset
+   OFS.  If the read picked up where the previous one left off,
+   queues the data after it to be read ahead, in a window that
+   grows with the length of the run of sequential reads. */
+static void
+read_ahead (struct file *file, off_t ofs, off_t bytes_read)
+{
+  bool sequential = ofs == file->ra_next;
+  off_t window, start, end;
+
+  file->ra_next = ofs + bytes_read;
+  if (!sequential)
+    {
+      file->ra_run = 0;
+      file->ra_end = 0;
+      return;
+    }
+  if (bytes_read == 0)
+    return;
+
+  if (file->ra_run < 16)
+    file->ra_run++;
+  window = RA_MIN << (file->ra_run - 1);
+  if (window > RA_MAX)
+    window = RA_MAX;
+
+  /* Only queue what earlier reads haven't already. */
+  start = file->ra_end > file->ra_next ? file->ra_end : file->ra_next;
+  end = file->ra_next + window;
+  if (start < end)
+    {
+      inode_read_ahead (file->inode, start, end - start);
+      file->ra_end = end;
+    }
+}
@@ -40,6 +40,30 @@ free_map_allocate (size_t cnt, block_sector_t *sectorp)
   return sector != BITMAP_ERROR;
 }
 
+/* Allocates up to CNT consecutive sectors starting at SECTOR,
+   stopping short at the first one already in use, and returns
+   how many were allocated.  Returns 0 if SECTOR is in use or if
+   the free_map file could not be written. */
+size_t
+free_map_extend (block_sector_t sector, size_t cnt)
+{
+  size_t n = 0;
+
+  while (n < cnt && sector + n < bitmap_size (free_map)
+         && !bitmap_test (free_map, sector + n))
+    n++;
+  if (n == 0)
+    return 0;
+
+  bitmap_set_multiple (free_map, sector, n, true);
+  if (free_map_file != NULL && !bitmap_write (free_map, free_map_file))
+    {
+      bitmap_set_multiple (free_map, sector, n, false);
+      return 0;
+    }
+  return n;
+}
+
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
@@ -3,6 +3,7 @@
 #include <debug.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
@@ -10,14 +11,41 @@
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* A run of consecutive data sectors. */
+struct extent
+  {
+    block_sector_t start;               /* First sector. */
+    uint32_t length;                    /* Number of sectors. */
+  };
+
+/* Number of extents in an inode and in its overflow block. */
+#define INODE_EXTENTS 62
+#define OVERFLOW_EXTENTS (BLOCK_SECTOR_SIZE / sizeof (struct extent))
+#define MAX_EXTENTS (INODE_EXTENTS + OVERFLOW_EXTENTS)
+
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+
+   A file's data is a list of extents, in file order.  The first
+   INODE_EXTENTS are kept in the inode itself and the rest in an
+   overflow block, a sector holding nothing but extents, allocated
+   the first time it is needed.  A file that grows extends its
+   last extent when the sectors after it are free, so files
+   written sequentially stay contiguous and need few extents. */
 struct inode_disk
   {
-    block_sector_t start;               /* First data sector. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    uint32_t extent_cnt;                /* Extents in use. */
+    block_sector_t overflow;            /* Overflow block, or 0 if none. */
+    struct extent extents[INODE_EXTENTS]; /* First extents. */
+  };
+
+/* Overflow block.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct overflow_block
+  {
+    struct extent extents[OVERFLOW_EXTENTS]; /* Extents after the first. */
   };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -37,8 +65,26 @@ struct inode
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
     struct inode_disk data;             /* Inode content. */
+    struct overflow_block *overflow;    /* Overflow block content, or null. */
   };
 
+static bool grow (struct inode *, off_t length,
+                  off_t write_ofs, off_t write_end);
+static void shrink (struct inode *, size_t extent_cnt, uint32_t last_length);
+static void release_sectors (struct inode *);
+static void write_inode (struct inode *);
+
+/* Returns extent I of INODE. */
+static struct extent *
+extent_at (const struct inode *inode, size_t i)
+{
+  ASSERT (i < MAX_EXTENTS);
+  if (i < INODE_EXTENTS)
+    return (struct extent *) &inode->data.extents[i];
+  else
+    return &inode->overflow->extents[i - INODE_EXTENTS];
+}
+
 /* Returns the block device sector that contains byte offset POS
    within INODE.
    Returns -1 if INODE does not contain data for a byte at offset
@@ -46,11 +92,34 @@ struct inode
 static block_sector_t
 byte_to_sector (const struct inode *inode, off_t pos) 
 {
+  size_t idx;
+  size_t i;
+
   ASSERT (inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
-  else
+  if (pos >= inode->data.length)
     return -1;
+
+  idx = pos / BLOCK_SECTOR_SIZE;
+  for (i = 0; i < inode->data.extent_cnt; i++)
+    {
+      const struct extent *e = extent_at (inode, i);
+      if (idx < e->length)
+        return e->start + idx;
+      idx -= e->length;
+    }
+  NOT_REACHED ();
+}
+
+/* Returns the number of data sectors allocated to INODE. */
+static size_t
+allocated_sectors (const struct inode *inode)
+{
+  size_t cnt = 0;
+  size_t i;
+
+  for (i = 0; i < inode->data.extent_cnt; i++)
+    cnt += extent_at (inode, i)->length;
+  return cnt;
 }
 
 /* List of open inodes, so that opening a single inode twice
@@ -72,35 +141,31 @@ inode_init (void)
 bool
 inode_create (block_sector_t sector, off_t length)
 {
-  struct inode_disk *disk_inode = NULL;
+  struct inode *inode = NULL;
   bool success = false;
 
   ASSERT (length >= 0);
 
-  /* If this assertion fails, the inode structure is not exactly
-     one sector in size, and you should fix that. */
-  ASSERT (sizeof *disk_inode == BLOCK_SECTOR_SIZE);
+  /* If these assertions fail, the inode structure or the overflow
+     block is not exactly one sector in size, and you should fix
+     that. */
+  ASSERT (sizeof inode->data == BLOCK_SECTOR_SIZE);
+  ASSERT (sizeof *inode->overflow == BLOCK_SECTOR_SIZE);
 
-  disk_inode = calloc (1, sizeof *disk_inode);
-  if (disk_inode != NULL)
+  /* Build the inode in memory, as if it were open. */
+  inode = calloc (1, sizeof *inode);
+  if (inode != NULL)
     {
-      size_t sectors = bytes_to_sectors (length);
-      disk_inode->length = length;
-      disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
+      inode->sector = sector;
+      inode->data.magic = INODE_MAGIC;
+      if (grow (inode, length, 0, 0)) 
         {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
-            }
+          inode->data.length = length;
+          write_inode (inode);
           success = true; 
         } 
-      free (disk_inode);
+      free (inode->overflow);
+      free (inode);
     }
   return success;
 }
@@ -137,7 +202,20 @@ inode_open (block_sector_t sector)
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  inode->overflow = NULL;
+  cache_read (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+  if (inode->data.overflow != 0)
+    {
+      inode->overflow = malloc (sizeof *inode->overflow);
+      if (inode->overflow == NULL)
+        {
+          list_remove (&inode->elem);
+          free (inode);
+          return NULL;
+        }
+      cache_read (inode->data.overflow, inode->overflow,
+                  0, BLOCK_SECTOR_SIZE);
+    }
   return inode;
 }
 
@@ -177,10 +255,10 @@ inode_close (struct inode *inode)
       if (inode->removed) 
         {
           free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          release_sectors (inode);
         }
 
+      free (inode->overflow);
       free (inode); 
     }
 }
@@ -202,7 +280,6 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
 
   while (size > 0) 
     {
@@ -220,51 +297,69 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
-        }
-      else 
-        {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-        }
+      cache_read (sector_idx, buffer + bytes_read, sector_ofs, chunk_size);
       
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
 
   return bytes_read;
 }
 
+/* Queues the sectors of INODE that hold the SIZE bytes starting
+   at OFFSET to be read into the buffer cache in the background.
+   Bytes past the end of INODE are ignored. */
+void
+inode_read_ahead (struct inode *inode, off_t offset, off_t size)
+{
+  off_t end = offset + size;
+
+  if (end > inode_length (inode))
+    end = inode_length (inode);
+  for (offset = ROUND_DOWN (offset, BLOCK_SECTOR_SIZE); offset < end;
+       offset += BLOCK_SECTOR_SIZE)
+    cache_read_ahead (byte_to_sector (inode, offset));
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if an error occurs or if the write ends past
+   end of file and the disk has no room to extend the inode.
+   A write past end of file extends the inode, filling any gap
+   with zeros.  If the inode cannot be extended far enough, it is
+   left its old size and only the part of the write that already
+   fits is done. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
 
   if (inode->deny_write_cnt)
     return 0;
 
+  if (size > 0 && offset + size > inode->data.length)
+    {
+      /* If the disk fills up, grow() takes back whatever it
+         allocated, so a failed write doesn't leave the file
+         holding sectors it never filled.  Only the part that fits
+         in the sectors the file already had is written, and the
+         length is left alone if none of it fits. */
+      off_t room, length;
+
+      grow (inode, offset + size, offset, offset + size);
+      room = allocated_sectors (inode) * BLOCK_SECTOR_SIZE;
+      length = offset + size < room ? offset + size : room;
+      if (length > offset && length > inode->data.length)
+        {
+          inode->data.length = length;
+          write_inode (inode);
+        }
+    }
+
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
@@ -281,42 +376,47 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
-        }
-      else 
-        {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
-        }
+      /* The cache reads in the rest of the sector first if the
+         chunk doesn't cover all of it. */
+      cache_write (sector_idx, buffer + bytes_written, sector_ofs,
+                   chunk_size);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
 
   return bytes_written;
 }
 
+/* Returns true if SECTOR holds INODE, its overflow block or
+   part of its data. */
+static bool
+inode_has_sector (block_sector_t sector, void *inode_)
+{
+  struct inode *inode = inode_;
+  size_t i;
+
+  if (sector == inode->sector
+      || (inode->data.overflow != 0 && sector == inode->data.overflow))
+    return true;
+  for (i = 0; i < inode->data.extent_cnt; i++)
+    {
+      const struct extent *e = extent_at (inode, i);
+      if (sector >= e->start && sector < e->start + e->length)
+        return true;
+    }
+  return false;
+}
+
+/* Writes INODE's modified sectors in the buffer cache to disk. */
+void
+inode_flush (struct inode *inode)
+{
+  cache_flush_if (inode_has_sector, inode);
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
@@ -343,3 +443,154 @@ inode_length (const struct inode *inode)
 {
   return inode->data.length;
 }
+
+/* Appends an extent of CNT sectors starting at START to INODE,
+   allocating its overflow block if it needs one.  Returns false
+   if INODE has no room for another extent. */
+static bool
+add_extent (struct inode *inode, block_sector_t start, size_t cnt)
+{
+  struct extent *e;
+
+  if (inode->data.extent_cnt == MAX_EXTENTS)
+    return false;
+  if (inode->data.extent_cnt == INODE_EXTENTS && inode->overflow == NULL)
+    {
+      inode->overflow = calloc (1, sizeof *inode->overflow);
+      if (inode->overflow == NULL)
+        return false;
+      if (!free_map_allocate (1, &inode->data.overflow))
+        {
+          free (inode->overflow);
+          inode->overflow = NULL;
+          return false;
+        }
+    }
+
+  e = extent_at (inode, inode->data.extent_cnt++);
+  e->start = start;
+  e->length = cnt;
+  return true;
+}
+
+/* Allocates zeroed data sectors to INODE until it has enough to
+   hold LENGTH bytes.  New sectors extend the last extent if the
+   sectors after it are free, and otherwise go in a new extent,
+   as long a run as can be found.  Sectors that lie wholly within
+   bytes WRITE_OFS to WRITE_END, which the caller is about to
+   overwrite, are not zeroed, so that an extending write puts each
+   sector through the cache only once.  Returns true if successful,
+   false if the disk or INODE's extents run out, in which case
+   INODE is left with the sectors it had before the call.  The
+   caller must write INODE to disk. */
+static bool
+grow (struct inode *inode, off_t length, off_t write_ofs, off_t write_end)
+{
+  static char zeros[BLOCK_SECTOR_SIZE];
+  size_t have = allocated_sectors (inode);
+  size_t need = bytes_to_sectors (length);
+  size_t old_extent_cnt = inode->data.extent_cnt;
+  uint32_t old_last_length = 0;
+
+  if (old_extent_cnt > 0)
+    old_last_length = extent_at (inode, old_extent_cnt - 1)->length;
+
+  while (have < need)
+    {
+      size_t want = need - have;
+      block_sector_t start = 0;
+      size_t got = 0;
+      size_t i;
+
+      if (inode->data.extent_cnt > 0)
+        {
+          struct extent *last = extent_at (inode,
+                                           inode->data.extent_cnt - 1);
+          start = last->start + last->length;
+          got = free_map_extend (start, want);
+          last->length += got;
+        }
+      if (got == 0)
+        {
+          for (got = want; got > 0; got /= 2)
+            if (free_map_allocate (got, &start))
+              break;
+          if (got == 0)
+            {
+              shrink (inode, old_extent_cnt, old_last_length);
+              return false;
+            }
+          if (!add_extent (inode, start, got))
+            {
+              free_map_release (start, got);
+              shrink (inode, old_extent_cnt, old_last_length);
+              return false;
+            }
+        }
+
+      for (i = 0; i < got; i++)
+        {
+          off_t sector_ofs = (off_t) (have + i) * BLOCK_SECTOR_SIZE;
+          if (sector_ofs < write_ofs
+              || sector_ofs + BLOCK_SECTOR_SIZE > write_end)
+            cache_write (start + i, zeros, 0, BLOCK_SECTOR_SIZE);
+        }
+      have += got;
+    }
+  return true;
+}
+
+/* Undoes a failed grow(), releasing every sector it allocated to
+   INODE, given the extent count and last extent length INODE had
+   before.  Releases the overflow block too if grow() added it. */
+static void
+shrink (struct inode *inode, size_t extent_cnt, uint32_t last_length)
+{
+  while (inode->data.extent_cnt > extent_cnt)
+    {
+      const struct extent *e = extent_at (inode,
+                                          --inode->data.extent_cnt);
+      free_map_release (e->start, e->length);
+    }
+  if (extent_cnt > 0)
+    {
+      struct extent *last = extent_at (inode, extent_cnt - 1);
+      if (last->length > last_length)
+        free_map_release (last->start + last_length,
+                          last->length - last_length);
+      last->length = last_length;
+    }
+  if (extent_cnt <= INODE_EXTENTS && inode->overflow != NULL)
+    {
+      free_map_release (inode->data.overflow, 1);
+      inode->data.overflow = 0;
+      free (inode->overflow);
+      inode->overflow = NULL;
+    }
+}
+
+/* Releases all of INODE's data sectors and its overflow block to
+   the free map. */
+static void
+release_sectors (struct inode *inode)
+{
+  size_t i;
+
+  for (i = 0; i < inode->data.extent_cnt; i++)
+    {
+      const struct extent *e = extent_at (inode, i);
+      free_map_release (e->start, e->length);
+    }
+  if (inode->data.overflow != 0)
+    free_map_release (inode->data.overflow, 1);
+}
+
+/* Writes INODE and its overflow block, if any, to disk. */
+static void
+write_inode (struct inode *inode)
+{
+  cache_write (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+  if (inode->overflow != NULL)
+    cache_write (inode->data.overflow, inode->overflow,
+                 0, BLOCK_SECTOR_SIZE);
+}
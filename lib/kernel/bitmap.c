@@ -288,6 +288,29 @@ bitmap_all (const struct bitmap *b, size_t start, size_t cnt)
 
 /* Finding set or unset bits. */
 
+/* Returns the index of the first bit in B at or after START that
+   is set to VALUE, or B's size if there is none.  Examines a
+   whole element at a time, so long runs of bits set to !VALUE
+   are skipped quickly. */
+static size_t
+next_bit (const struct bitmap *b, size_t start, bool value)
+{
+  size_t idx = elem_idx (start);
+  size_t cnt = elem_cnt (b->bit_cnt);
+  elem_type mask = (elem_type) -1 << (start % ELEM_BITS);
+
+  for (; idx < cnt; idx++, mask = (elem_type) -1)
+    {
+      elem_type bits = (value ? b->bits[idx] : ~b->bits[idx]) & mask;
+      if (bits != 0)
+        {
+          size_t bit = idx * ELEM_BITS + __builtin_ctzl (bits);
+          return bit < b->bit_cnt ? bit : b->bit_cnt;
+        }
+    }
+  return b->bit_cnt;
+}
+
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
@@ -298,13 +321,27 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
+  if (cnt == 0)
+    return start;
   if (cnt <= b->bit_cnt) 
     {
       size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      size_t i = start;
+
+      /* Jump from each run of VALUE bits to the next, checking
+         whether the run is long enough. */
+      while (i <= last)
+        {
+          size_t end;
+
+          i = next_bit (b, i, value);
+          if (i > last)
+            break;
+          end = next_bit (b, i, !value);
+          if (end - i >= cnt)
+            return i;
+          i = end;
+        }
     }
   return BITMAP_ERROR;
 }
@@ -0,0 +1,127 @@
+#include "lz.h"
+#include <debug.h>
+#include <string.h>
+
+/* Longest distance and length of a back-reference. */
+#define MAX_DISTANCE 4095
+#define MIN_MATCH 3
+#define MAX_MATCH (MIN_MATCH + 15)
+
+/* Returns a hash of the 3 bytes at P. */
+static inline unsigned
+hash3 (const uint8_t *p)
+{
+  uint32_t x = ((uint32_t) p[0] << 16) | ((uint32_t) p[1] << 8) | p[2];
+  return (x * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Compresses the SRC_SIZE bytes at SRC into the DST_SIZE bytes
+   at DST, using TABLE as scratch space.  Returns the size of the
+   compressed data, or 0 if it would not fit in DST_SIZE bytes. */
+size_t
+lz_compress (const void *src_, size_t src_size,
+             void *dst_, size_t dst_size, uint16_t table[LZ_TABLE_SIZE])
+{
+  const uint8_t *src = src_;
+  const uint8_t *end = src + src_size;
+  const uint8_t *p = src;
+  uint8_t *dst = dst_;
+  uint8_t *dst_end = dst + dst_size;
+  uint8_t *ctrl = NULL;
+  int bit = 8;
+
+  ASSERT (src_size <= LZ_MAX_SIZE);
+
+  memset (table, 0, LZ_TABLE_SIZE * sizeof *table);
+  while (p < end)
+    {
+      /* Start a new group. */
+      if (bit == 8)
+        {
+          if (dst >= dst_end)
+            return 0;
+          ctrl = dst++;
+          *ctrl = 0;
+          bit = 0;
+        }
+
+      if (end - p >= MIN_MATCH)
+        {
+          unsigned h = hash3 (p);
+          const uint8_t *cand = src + table[h];
+          size_t distance = p - cand;
+
+          table[h] = p - src;
+          if (cand < p && distance <= MAX_DISTANCE
+              && cand[0] == p[0] && cand[1] == p[1] && cand[2] == p[2])
+            {
+              size_t max = end - p < MAX_MATCH ? (size_t) (end - p) : MAX_MATCH;
+              size_t len = MIN_MATCH;
+
+              while (len < max && cand[len] == p[len])
+                len++;
+              if (dst_end - dst < 2)
+                return 0;
+              *dst++ = distance >> 4;
+              *dst++ = ((distance & 0xf) << 4) | (len - MIN_MATCH);
+              *ctrl |= 1 << bit++;
+              p += len;
+              continue;
+            }
+        }
+
+      if (dst >= dst_end)
+        return 0;
+      *dst++ = *p++;
+      bit++;
+    }
+  return dst - (uint8_t *) dst_;
+}
+
+/* Decompresses the SRC_SIZE bytes at SRC, produced by
+   lz_compress(), into the DST_SIZE bytes at DST.  Returns the
+   size of the decompressed data, or 0 if SRC is malformed or
+   decompresses to more than DST_SIZE bytes. */
+size_t
+lz_decompress (const void *src_, size_t src_size,
+               void *dst_, size_t dst_size)
+{
+  const uint8_t *src = src_;
+  const uint8_t *src_end = src + src_size;
+  uint8_t *dst = dst_;
+  uint8_t *d = dst;
+  uint8_t *dst_end = dst + dst_size;
+
+  while (src < src_end)
+    {
+      uint8_t ctrl = *src++;
+      int bit;
+
+      for (bit = 0; bit < 8 && src < src_end; bit++)
+        if (ctrl & (1 << bit))
+          {
+            size_t distance, len;
+
+            if (src_end - src < 2)
+              return 0;
+            distance = (src[0] << 4) | (src[1] >> 4);
+            len = (src[1] & 0xf) + MIN_MATCH;
+            src += 2;
+            if (distance == 0 || distance > (size_t) (d - dst)
+                || len > (size_t) (dst_end - d))
+              return 0;
+
+            /* Copy a byte at a time: the source may overlap the
+               destination when DISTANCE < LEN. */
+            for (; len > 0; len--, d++)
+              *d = *(d - distance);
+          }
+        else
+          {
+            if (d >= dst_end)
+              return 0;
+            *d++ = *src++;
+          }
+    }
+  return d - dst;
+}
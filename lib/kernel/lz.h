@@ -0,0 +1,34 @@
+#ifndef __LIB_KERNEL_LZ_H
+#define __LIB_KERNEL_LZ_H
+
+/* LZ77-style compression.
+
+   A fast, simple codec in the LZRW1/LZSS family, meant for
+   compressing pages of memory rather than files.  The compressed
+   data is a sequence of groups, each a control byte followed by
+   up to 8 items.  Bit I of the control byte, counting from the
+   least significant, says whether item I is a literal byte (0)
+   or a 2-byte back-reference (1) holding a 12-bit distance and a
+   4-bit length of 3 to 18 bytes.
+
+   The compressor finds matches through a hash table of recent
+   positions, which the caller supplies so that the codec itself
+   needs no memory. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Number of entries in the compressor's hash table. */
+#define LZ_HASH_BITS 12
+#define LZ_TABLE_SIZE (1 << LZ_HASH_BITS)
+
+/* Largest input lz_compress() accepts. */
+#define LZ_MAX_SIZE 65535
+
+size_t lz_compress (const void *src, size_t src_size,
+                    void *dst, size_t dst_size,
+                    uint16_t table[LZ_TABLE_SIZE]);
+size_t lz_decompress (const void *src, size_t src_size,
+                      void *dst, size_t dst_size);
+
+#endif /* lib/kernel/lz.h */
@@ -0,0 +1,20 @@
+#ifndef __LIB_PROCSTAT_H
+#define __LIB_PROCSTAT_H
+
+/* Memory statistics of a user process, as returned by the
+   procstat() system call.  Counts are in pages. */
+struct procstat
+  {
+    int pid;                    /* Process identifier. */
+    char name[16];              /* Process name. */
+    unsigned minor_faults;      /* Faults served without I/O. */
+    unsigned major_faults;      /* Faults that read a file or swap. */
+    unsigned swap_ins;          /* Pages read back from swap. */
+    unsigned swap_outs;         /* Pages written to swap. */
+    unsigned swap_pages;        /* Pages now in swap. */
+    unsigned rss;               /* Pages now in frames. */
+    unsigned peak_rss;          /* Most pages ever in frames. */
+    unsigned mmap_rss;          /* Pages of mapped files now in frames. */
+  };
+
+#endif /* lib/procstat.h */
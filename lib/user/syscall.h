@@ -2,7 +2,9 @@
 #define __LIB_USER_SYSCALL_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <debug.h>
+#include <procstat.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -12,6 +14,13 @@ typedef int pid_t;
 typedef int mapid_t;
 #define MAP_FAILED ((mapid_t) -1)
 
+/* Advice for madvise(). */
+#define MADV_NORMAL 0           /* No special treatment. */
+#define MADV_RANDOM 1           /* Random access: no fault-around. */
+#define MADV_SEQUENTIAL 2       /* Sequential: bring in far ahead. */
+#define MADV_WILLNEED 3         /* Needed soon: prefetch. */
+#define MADV_DONTNEED 4         /* Not needed: drop now. */
+
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
@@ -45,4 +54,10 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+pid_t fork (void);
+int madvise (void *addr, size_t length, int advice);
+pid_t procstat (pid_t, struct procstat *);
+int fsync (int fd);
+
 #endif /* lib/user/syscall.h */
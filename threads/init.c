@@ -37,10 +37,27 @@
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+#include "vm/zswap.h"
+#endif
 
 /* Page directory with kernel mappings only. */
 uint32_t *init_page_dir;
 
+/* CR4 bits that enable 4 MB pages (PTE_PS) and global pages
+   (PTE_G). */
+#define CR4_PSE 0x00000010
+#define CR4_PGE 0x00000080
+
+/* CPUID function 1 EDX bit for 4 MB page support. */
+#define CPUID_PSE 0x00000008
+
+/* -nopse: Map kernel memory with 4 kB pages only? */
+static bool no_large_pages;
+
 #ifdef FILESYS
 /* -f: Format the file system? */
 static bool format_filesys;
@@ -57,8 +74,15 @@ static const char *swap_bdev_name;
 /* -ul: Maximum number of pages to put into palloc's user pool. */
 static size_t user_page_limit = SIZE_MAX;
 
+#ifdef VM
+/* -freelow, -freehigh: Pager thread's free frame watermarks. */
+static size_t pager_low;
+static size_t pager_high;
+#endif
+
 static void bss_init (void);
 static void paging_init (void);
+static bool cpu_has_pse (void);
 
 static char **read_command_line (void);
 static char **parse_options (char **argv);
@@ -98,6 +122,11 @@ main (void)
   palloc_init (user_page_limit);
   malloc_init ();
   paging_init ();
+#ifdef VM
+  frame_set_watermarks (pager_low, pager_high);
+  frame_init ();
+  page_init ();
+#endif
 
   /* Segmentation. */
 #ifdef USERPROG
@@ -120,12 +149,21 @@ main (void)
   thread_start ();
   serial_init_queue ();
   timer_calibrate ();
+#ifdef USERPROG
+  process_start_reaper ();
+#endif
 
 #ifdef FILESYS
   /* Initialize file system. */
   ide_init ();
   locate_block_devices ();
   filesys_init (format_filesys);
+#ifdef VM
+  swap_init ();
+  frame_start_pager ();
+  frame_start_merger ();
+  page_start_prefetcher ();
+#endif
 #endif
 
   printf ("Boot complete.\n");
@@ -154,12 +192,22 @@ bss_init (void)
 /* Populates the base page directory and page table with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points init_page_dir to the page
-   directory it creates. */
+   directory it creates.
+
+   Each 4 MB of RAM is mapped with a single 4 MB PDE if the CPU
+   supports it, which saves a page table per 4 MB and lets one
+   TLB entry cover what would otherwise take 1,024.  The 4 MB
+   that hold the kernel text are mapped with 4 kB pages anyway,
+   so that the text can be read-only without making its
+   neighbours read-only too, and so is a partial 4 MB at the end
+   of RAM. */
 static void
 paging_init (void)
 {
   uint32_t *pd, *pt;
   size_t page;
+  size_t large_cnt = 0, pt_cnt = 0;
+  bool pse = !no_large_pages && cpu_has_pse ();
   extern char _start, _end_kernel_text;
 
   pd = init_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
@@ -174,19 +222,57 @@ paging_init (void)
 
       if (pd[pde_idx] == 0)
         {
+          char *end = vaddr + PTSPAN;
+
+          if (pse && pte_idx == 0 && page + PTSPAN / PGSIZE <= init_ram_pages
+              && (end <= &_start || vaddr >= &_end_kernel_text))
+            {
+              pd[pde_idx] = pde_create_large (vaddr, true);
+              large_cnt++;
+              page += PTSPAN / PGSIZE - 1;
+              continue;
+            }
+
           pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
           pd[pde_idx] = pde_create (pt);
+          pt_cnt++;
         }
 
       pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
     }
 
+  /* 4 MB pages must be enabled before they are used. */
+  if (pse)
+    asm volatile ("movl %%cr4, %%eax; orl %0, %%eax; movl %%eax, %%cr4"
+                  : : "i" (CR4_PSE) : "eax", "memory");
+
   /* Store the physical address of the page directory into CR3
      aka PDBR (page directory base register).  This activates our
      new page tables immediately.  See [IA32-v2a] "MOV--Move
      to/from Control Registers" and [IA32-v3a] 3.7.5 "Base Address
      of the Page Directory". */
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)));
+
+  /* Turn on global pages, so that the kernel mappings created
+     above, which are marked PTE_G, stay in the TLB across the
+     CR3 reloads done on process switches.  See [IA32-v3a] 3.11
+     "Translation Lookaside Buffers (TLBs)". */
+  asm volatile ("movl %%cr4, %%eax; orl %0, %%eax; movl %%eax, %%cr4"
+                : : "i" (CR4_PGE) : "eax", "memory");
+
+  printf ("Kernel mapping: %zu 4 MB pages, %zu page tables.\n",
+          large_cnt, pt_cnt);
+}
+
+/* Returns true if the CPU supports 4 MB pages.  See [IA32-v2a]
+   "CPUID--CPU Identification". */
+static bool
+cpu_has_pse (void)
+{
+  uint32_t eax = 1, ebx, ecx, edx;
+
+  asm ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  return (edx & CPUID_PSE) != 0;
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -257,9 +343,33 @@ parse_options (char **argv)
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-nopse"))
+        no_large_pages = true;
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-evict"))
+        {
+          if (!frame_set_policy (value))
+            PANIC ("unknown replacement policy `%s' (use -h for help)",
+                   value);
+        }
+      else if (!strcmp (name, "-freelow"))
+        pager_low = atoi (value);
+      else if (!strcmp (name, "-freehigh"))
+        pager_high = atoi (value);
+      else if (!strcmp (name, "-zswap"))
+        zswap_set_size (atoi (value));
+      else if (!strcmp (name, "-stack"))
+        page_set_stack_limit (atoi (value) * 1024);
+      else if (!strcmp (name, "-faultaround"))
+        page_set_fault_around (atoi (value));
+      else if (!strcmp (name, "-merge"))
+        frame_set_merge_rate (atoi (value));
+      else if (!strcmp (name, "-vmstat"))
+        process_set_exit_stats (true);
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -380,8 +490,20 @@ usage (void)
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -nopse             Map kernel memory with 4 kB pages only.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+          "  -evict=POLICY      Use POLICY (clock, aging or wsclock) to\n"
+          "                     choose pages to evict; clock by default.\n"
+          "  -freelow=COUNT     Wake pager when fewer than COUNT frames free.\n"
+          "  -freehigh=COUNT    Pager frees frames until COUNT are free.\n"
+          "  -zswap=PAGES       Use PAGES pages for compressed swap cache.\n"
+          "  -stack=KB          Let user stacks grow to KB kB (default 8192).\n"
+          "  -faultaround=N     Map up to N pages around a fault (default 4).\n"
+          "  -merge=PAGES       Scan PAGES frames/s for identical pages to merge.\n"
+          "  -vmstat            Print memory statistics of exiting processes.\n"
 #endif
           );
   shutdown_power_off ();
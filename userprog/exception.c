@@ -5,6 +5,10 @@
 #include "userprog/gdt.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
@@ -150,6 +154,32 @@ page_fault (struct intr_frame *f)
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
 
+#ifdef VM
+  /* A page that is part of the process's address space but has
+     not been brought in yet, or an access just below the stack
+     that calls for growing it.  This applies to faults in the
+     kernel too, e.g. when a system call copies into a user
+     buffer that was never touched, in which case f->esp is the
+     kernel's stack pointer and we need the user's, saved when
+     the system call began. */
+  if (not_present && is_user_vaddr (fault_addr))
+    {
+      void *esp = user ? f->esp : thread_current ()->user_esp;
+
+      if (page_in (pg_round_down (fault_addr), write)
+          || page_grow_stack (fault_addr, esp))
+        return;
+    }
+
+  /* A write to a page that is mapped read-only until it is
+     written: an all-zero page mapped to the shared zero page, or
+     a page whose frame fork() left shared.  It gets a frame of
+     its own now. */
+  if (!not_present && write && is_user_vaddr (fault_addr)
+      && page_copy_on_write (pg_round_down (fault_addr)))
+    return;
+#endif
+
   if(!user) { /*according to the pintos documentation...*/
     f->eip = f->eax;
     f->eax = 0xffffffff;
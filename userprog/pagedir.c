@@ -1,16 +1,29 @@
 #include "userprog/pagedir.h"
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
 
+/* Statistics. */
+static long long pd_load_cnt;   /* # of CR3 loads on activation. */
+static long long pd_skip_cnt;   /* # of activations that kept CR3. */
+static long long invlpg_cnt;    /* # of single-page invalidations. */
+static long long flush_cnt;     /* # of full TLB flushes. */
+
 static uint32_t *active_pd (void);
+static void load_pd (uint32_t *);
 static void invalidate_pagedir (uint32_t *);
+static void invalidate_page (uint32_t *, const void *);
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
+   The kernel PDEs are copied as they are, so 4 MB pages and
+   page tables of the kernel mapping are shared by every page
+   directory.
    Returns the new page directory, or a null pointer if memory
    allocation fails. */
 uint32_t *
@@ -52,7 +65,9 @@ pagedir_destroy (uint32_t *pd)
    If PD does not have a page table for VADDR, behavior depends
    on CREATE.  If CREATE is true, then a new page table is
    created and a pointer into it is returned.  Otherwise, a null
-   pointer is returned. */
+   pointer is returned.  A null pointer is also returned if VADDR
+   is in a 4 MB page of the kernel mapping, which has no page
+   table entry. */
 static uint32_t *
 lookup_page (uint32_t *pd, const void *vaddr, bool create)
 {
@@ -70,16 +85,36 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
     {
       if (create)
         {
+          enum intr_level old_level;
+
           pt = palloc_get_page (PAL_ZERO);
           if (pt == NULL)
             return NULL;
 
-          *pde = pde_create (pt);
+          /* The prefetcher maps pages into other processes' page
+             directories, so another thread may have added the
+             page table while we slept in palloc_get_page(). */
+          old_level = intr_disable ();
+          if (*pde == 0)
+            {
+              *pde = pde_create (pt);
+              pt = NULL;
+            }
+          intr_set_level (old_level);
+          if (pt != NULL)
+            palloc_free_page (pt);
         }
       else
         return NULL;
     }
 
+  /* Large pages only map kernel memory, and there is no PTE. */
+  if (pde_is_large (*pde))
+    {
+      ASSERT (!create);
+      return NULL;
+    }
+
   /* Return the page table entry. */
   pt = pde_get_pt (*pde);
   return &pt[pt_no (vaddr)];
@@ -142,17 +177,32 @@ pagedir_get_page (uint32_t *pd, const void *uaddr)
    UPAGE need not be mapped. */
 void
 pagedir_clear_page (uint32_t *pd, void *upage)
+{
+  struct tlb_gather tlb;
+
+  tlb_gather_init (&tlb, pd);
+  pagedir_gather_clear_page (&tlb, upage);
+  tlb_gather_finish (&tlb);
+}
+
+/* Like pagedir_clear_page(), for the page directory that TLB
+   was initialized with, but only records UPAGE in TLB instead of
+   invalidating it at once.  The caller must call
+   tlb_gather_finish() before the frame that UPAGE mapped is
+   reused. */
+void
+pagedir_gather_clear_page (struct tlb_gather *tlb, void *upage)
 {
   uint32_t *pte;
 
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (is_user_vaddr (upage));
 
-  pte = lookup_page (pd, upage, false);
+  pte = lookup_page (tlb->pd, upage, false);
   if (pte != NULL && (*pte & PTE_P) != 0)
     {
       *pte &= ~PTE_P;
-      invalidate_pagedir (pd);
+      tlb_gather_page (tlb, upage);
     }
 }
 
@@ -167,6 +217,31 @@ pagedir_is_dirty (uint32_t *pd, const void *vpage)
   return pte != NULL && (*pte & PTE_D) != 0;
 }
 
+/* Returns true if PD maps user virtual page VPAGE writable,
+   false if it maps it read-only or not at all. */
+bool
+pagedir_is_writable (uint32_t *pd, const void *vpage)
+{
+  uint32_t *pte = lookup_page (pd, vpage, false);
+  return pte != NULL && (*pte & (PTE_P | PTE_W)) == (PTE_P | PTE_W);
+}
+
+/* Makes the mapping for user virtual page VPAGE in PD, which
+   must be present, read/write if WRITABLE is true and read-only
+   otherwise, keeping its accessed and dirty bits. */
+void
+pagedir_set_writable (uint32_t *pd, const void *vpage, bool writable)
+{
+  uint32_t *pte = lookup_page (pd, vpage, false);
+
+  ASSERT (pte != NULL && (*pte & PTE_P) != 0);
+  if (writable)
+    *pte |= PTE_W;
+  else
+    *pte &= ~(uint32_t) PTE_W;
+  invalidate_page (pd, vpage);
+}
+
 /* Set the dirty bit to DIRTY in the PTE for virtual page VPAGE
    in PD. */
 void
@@ -180,7 +255,7 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
       else
         {
           *pte &= ~(uint32_t) PTE_D;
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
@@ -209,24 +284,96 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
       else
         {
           *pte &= ~(uint32_t) PTE_A;
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
 
 /* Loads page directory PD into the CPU's page directory base
-   register. */
+   register.
+
+   If PD is already active, as when switching between kernel
+   threads, which all run on init_page_dir, CR3 is left alone:
+   reloading it would only flush TLB entries that are still
+   valid. */
 void
 pagedir_activate (uint32_t *pd)
 {
   if (pd == NULL)
     pd = init_page_dir;
 
-  /* Store the physical address of the page directory into CR3
-     aka PDBR (page directory base register).  This activates our
-     new page tables immediately.  See [IA32-v2a] "MOV--Move
-     to/from Control Registers" and [IA32-v3a] 3.7.5 "Base
-     Address of the Page Directory". */
+  if (active_pd () == pd)
+    {
+      pd_skip_cnt++;
+      return;
+    }
+
+  pd_load_cnt++;
+  load_pd (pd);
+}
+
+/* Prints page directory statistics. */
+void
+pagedir_print_stats (void)
+{
+  printf ("Paging: %lld page directory loads, %lld skipped\n",
+          pd_load_cnt, pd_skip_cnt);
+  printf ("Paging: %lld single-page TLB invalidations, %lld full flushes\n",
+          invlpg_cnt, flush_cnt);
+}
+
+/* Starts gathering TLB invalidations for page directory PD. */
+void
+tlb_gather_init (struct tlb_gather *tlb, uint32_t *pd)
+{
+  ASSERT (pd != NULL);
+
+  tlb->pd = pd;
+  tlb->page_cnt = 0;
+}
+
+/* Records that the PTE for user virtual page UPAGE in TLB's
+   page directory has changed in a way that needs its TLB entry
+   invalidated.  Once more than TLB_GATHER_MAX pages have been
+   recorded, tlb_gather_finish() flushes the whole TLB instead
+   of invalidating pages one by one. */
+void
+tlb_gather_page (struct tlb_gather *tlb, const void *upage)
+{
+  if (tlb->page_cnt < TLB_GATHER_MAX)
+    tlb->pages[tlb->page_cnt] = upage;
+  tlb->page_cnt++;
+}
+
+/* Carries out the invalidations gathered in TLB, if its page
+   directory is active, and resets TLB for reuse. */
+void
+tlb_gather_finish (struct tlb_gather *tlb)
+{
+  if (tlb->page_cnt == 0)
+    return;
+
+  if (tlb->page_cnt > TLB_GATHER_MAX)
+    invalidate_pagedir (tlb->pd);
+  else
+    {
+      size_t i;
+
+      for (i = 0; i < tlb->page_cnt; i++)
+        invalidate_page (tlb->pd, tlb->pages[i]);
+    }
+  tlb->page_cnt = 0;
+}
+
+/* Stores the physical address of page directory PD into CR3
+   aka PDBR (page directory base register).  This activates
+   PD's page tables immediately and flushes all non-global TLB
+   entries.  See [IA32-v2a] "MOV--Move to/from Control
+   Registers" and [IA32-v3a] 3.7.5 "Base Address of the Page
+   Directory". */
+static void
+load_pd (uint32_t *pd)
+{
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (pd)) : "memory");
 }
 
@@ -243,7 +390,7 @@ active_pd (void)
   return ptov (pd);
 }
 
-/* Seom page table changes can cause the CPU's translation
+/* Some page table changes can cause the CPU's translation
    lookaside buffer (TLB) to become out-of-sync with the page
    table.  When this happens, we have to "invalidate" the TLB by
    re-activating it.
@@ -256,8 +403,25 @@ invalidate_pagedir (uint32_t *pd)
 {
   if (active_pd () == pd)
     {
-      /* Re-activating PD clears the TLB.  See [IA32-v3a] 3.12
+      /* Reloading CR3 clears the TLB, except for global kernel
+         entries, which never change.  See [IA32-v3a] 3.12
          "Translation Lookaside Buffers (TLBs)". */
-      pagedir_activate (pd);
+      flush_cnt++;
+      load_pd (pd);
+    }
+}
+
+/* Invalidates the TLB entry for virtual page VPAGE if PD is the
+   active page directory.  This is much cheaper than
+   invalidate_pagedir() when only one PTE changed, because the
+   rest of the TLB stays warm.  See [IA32-v2a] "INVLPG--Invalidate
+   TLB Entry". */
+static void
+invalidate_page (uint32_t *pd, const void *vpage)
+{
+  if (active_pd () == pd)
+    {
+      invlpg_cnt++;
+      asm volatile ("invlpg (%0)" : : "r" (vpage) : "memory");
     }
 }
@@ -2,17 +2,41 @@
 #define USERPROG_PAGEDIR_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+/* Most pages whose TLB entries a struct tlb_gather invalidates
+   one by one.  Past this, flushing the whole TLB is cheaper. */
+#define TLB_GATHER_MAX 32
+
+/* Batch of pending TLB invalidations for one page directory.
+   Operations that change many PTEs record each page with
+   tlb_gather_page(), then invalidate them all at once with
+   tlb_gather_finish(). */
+struct tlb_gather
+  {
+    uint32_t *pd;                       /* Page directory. */
+    size_t page_cnt;                    /* Number of pages gathered. */
+    const void *pages[TLB_GATHER_MAX];  /* Pages to invalidate. */
+  };
+
 uint32_t *pagedir_create (void);
 void pagedir_destroy (uint32_t *pd);
 bool pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool rw);
 void *pagedir_get_page (uint32_t *pd, const void *upage);
 void pagedir_clear_page (uint32_t *pd, void *upage);
+void pagedir_gather_clear_page (struct tlb_gather *, void *upage);
 bool pagedir_is_dirty (uint32_t *pd, const void *upage);
+bool pagedir_is_writable (uint32_t *pd, const void *upage);
+void pagedir_set_writable (uint32_t *pd, const void *upage, bool writable);
 void pagedir_set_dirty (uint32_t *pd, const void *upage, bool dirty);
 bool pagedir_is_accessed (uint32_t *pd, const void *upage);
 void pagedir_set_accessed (uint32_t *pd, const void *upage, bool accessed);
 void pagedir_activate (uint32_t *pd);
+void pagedir_print_stats (void);
+
+void tlb_gather_init (struct tlb_gather *, uint32_t *pd);
+void tlb_gather_page (struct tlb_gather *, const void *upage);
+void tlb_gather_finish (struct tlb_gather *);
 
 #endif /* userprog/pagedir.h */
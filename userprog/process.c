@@ -6,10 +6,13 @@
 #include <string.h>
 #include <hash.h>
 
+#include "devices/timer.h"
+
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
 #include "userprog/tss.h"
 #include "userprog/process.h"
+#include "userprog/syscall.h"
 
 #include "filesys/directory.h"
 #include "filesys/file.h"
@@ -24,7 +27,11 @@
 #include "threads/vaddr.h"
 #include "threads/synch.h"
 
+#ifdef VM
 #include "vm/frame.h"
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
 
 typedef struct struct_child {
   struct hash_elem hash_elem;
@@ -37,6 +44,9 @@ typedef struct struct_child {
   bool success_load;
   bool waiting;
   int32_t exit_status;
+#ifdef VM
+  struct procstat stats; /*memory stats when it exited*/
+#endif
 } child;
 
 child* child_new(const char *prog);
@@ -44,7 +54,7 @@ void child_delete(child *c);
 
 child *child_new(const char *prog) {
   child *c = (child*) malloc(sizeof(child));
-  c->prog = (char*) get_frame(0);
+  c->prog = (char*) palloc_get_page(0);
   c->sema = (struct semaphore*) malloc(sizeof(struct semaphore));
   int argvMAX = 40;
   c->argv = (char**) malloc(sizeof(char*) * 40); /* "40" needs to be changed*/
@@ -64,6 +74,9 @@ child *child_new(const char *prog) {
   c->success_load = c->waiting = false;
 
   c->exit_status = 0; /*default success for exit status*/
+#ifdef VM
+  memset(&c->stats, 0, sizeof c->stats);
+#endif
 
   char *prog_tok;
   char *rest_ptr;
@@ -147,9 +160,80 @@ static void hash_children_deleteChild(const tid_t tid) {
 static thread_func start_process NO_RETURN;
 static bool load (const child *childProcess, void (**eip) (void), void **esp);
 
+#ifdef VM
+/* What a process created by fork() starts from. */
+struct fork_info
+  {
+    child *cp;                  /* The new process's record. */
+    struct thread *parent;      /* Forking process, waiting for us. */
+    struct intr_frame if_;      /* Parent's user registers. */
+  };
+
+static thread_func start_fork NO_RETURN;
+#endif
+
+/* Reaper thread.
+
+   Freeing a large address space takes a while, so process_exit()
+   only unlinks it from the exiting process and queues it here,
+   and the parent's wait() returns right away.  The reaper frees
+   queued address spaces in the background. */
+struct reap_job
+  {
+    struct list_elem elem;      /* Element in reap_list. */
+    uint32_t *pagedir;          /* Page directory. */
+    struct file *executable;    /* Kept open until its pages are freed. */
+#ifdef VM
+    struct hash pages;          /* Supplemental page table. */
+    struct page_acct *acct;     /* Memory accounting, or null. */
+#endif
+  };
+
+static struct list reap_list;           /* Queued reap_jobs. */
+static struct lock reap_lock;           /* Protects reap_list. */
+static struct condition reap_ready;     /* Signaled when a job is queued. */
+static bool reaper_running;             /* Has reaper thread started? */
+
+/* Statistics on the reaper. */
+static long long reap_cnt;              /* # of address spaces freed. */
+static long long reap_sync_cnt;         /* # freed by process_exit(). */
+static int64_t reap_ticks;              /* Ticks spent freeing them. */
+static size_t reap_queued;              /* # of jobs now queued. */
+static size_t reap_peak;                /* Most jobs ever queued. */
+
+#ifdef VM
+/* Print memory statistics along with each exit status? */
+static bool exit_stats;
+#endif
+
+static thread_func reaper NO_RETURN;
+static void reap (uint32_t *pd, struct file *executable);
+static void free_address_space (struct reap_job *);
+
 void process_init(void) {
   hash_children = (struct hash*) malloc(sizeof(struct hash));
   hash_init(hash_children, hash_child_hash, hash_child_less, NULL);
+  list_init (&reap_list);
+  lock_init (&reap_lock);
+  cond_init (&reap_ready);
+}
+
+/* Starts the reaper thread.  Until it is started, exiting
+   processes free their own address spaces. */
+void
+process_start_reaper (void)
+{
+  if (thread_create ("reaper", PRI_DEFAULT, reaper, NULL) != TID_ERROR)
+    reaper_running = true;
+}
+
+/* Prints statistics on process teardown. */
+void
+process_print_stats (void)
+{
+  printf ("Reaper: %lld address spaces freed in %"PRId64" ticks, "
+          "%lld by exiting processes, up to %zu queued\n",
+          reap_cnt, reap_ticks, reap_sync_cnt, reap_peak);
 }
 
 void process_done(void) {
@@ -242,6 +326,95 @@ start_process (void *cp) /*@Nico: void *file_name_ need to be changed to a child
   NOT_REACHED ();
 }
 
+#ifdef VM
+/* Starts a new thread running a copy of the current user
+   process, which entered the kernel through system call frame F.
+   The copy shares the parent's memory copy-on-write and has its
+   own handles on the parent's open files, and returns from the
+   same system call with a value of 0.  Returns the new process's
+   thread id, or TID_ERROR if it cannot be created.
+
+   Unlike process_execute(), nothing is read from the executable,
+   which makes this the cheap way to start another copy of a
+   process that has already warmed up. */
+tid_t
+process_fork (const struct intr_frame *f)
+{
+  struct thread *cur = thread_current ();
+  struct fork_info info;
+  tid_t tid;
+
+  info.cp = child_new (cur->name);
+  if (info.cp == NULL)
+    return TID_ERROR;
+  info.parent = cur;
+  info.if_ = *f;
+  info.if_.eax = 0;
+
+  tid = thread_create (cur->name, PRI_DEFAULT, start_fork, &info);
+  if (tid == TID_ERROR)
+    {
+      child_delete (info.cp);
+      return TID_ERROR;
+    }
+
+  info.cp->tid = tid;
+  hash_insert (hash_children, &info.cp->hash_elem);
+
+  /* Wait for the child to copy our address space, which must
+     not change until then. */
+  sema_down (info.cp->sema);
+  if (!info.cp->success_load)
+    {
+      hash_children_deleteChild (tid);
+      return TID_ERROR;
+    }
+  return tid;
+}
+
+/* A thread function that copies the process that called
+   process_fork() and starts the copy running. */
+static void
+start_fork (void *info_)
+{
+  struct fork_info *info = info_;
+  struct thread *t = thread_current ();
+  struct thread *parent = info->parent;
+  child *cp = info->cp;
+  struct intr_frame if_ = info->if_;
+  bool success = false;
+
+  t->pagedir = pagedir_create ();
+  if (t->pagedir != NULL)
+    {
+      process_activate ();
+      mmap_init ();
+      if (page_table_init (t))
+        {
+          lock_acquire (&lock_filesys);
+          t->executable = file_reopen (parent->executable);
+          if (t->executable != NULL)
+            file_deny_write (t->executable);
+          lock_release (&lock_filesys);
+
+          success = (t->executable != NULL
+                     && page_table_copy (parent, t->executable)
+                     && syscall_inherit_files (parent->tid));
+        }
+    }
+  cp->success_load = success;
+
+  /* INFO is on the parent's stack, so it must not be used once
+     the parent is released. */
+  if (!success)
+    thread_exit ();
+  sema_up (cp->sema);
+
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+#endif
+
 /* Waits for thread TID to die and returns its exit status.  If
    it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If TID is invalid or if it was not a
@@ -265,6 +438,14 @@ process_wait (tid_t child_tid)
       c->waiting = false;
       ret = c->exit_status;
       printf ("%s: exit(%d)\n", c->fname, ret); /*exit feedback*/
+#ifdef VM
+      if (exit_stats)
+        printf ("%s: %u minor and %u major faults, %u pages swapped in, "
+                "%u out, rss %u pages (peak %u, %u of mapped files)\n",
+                c->fname, c->stats.minor_faults, c->stats.major_faults,
+                c->stats.swap_ins, c->stats.swap_outs, c->stats.rss,
+                c->stats.peak_rss, c->stats.mmap_rss);
+#endif
       hash_children_deleteChild(child_tid);
     }
   } else {
@@ -283,26 +464,44 @@ process_exit ()
 
   /* now I'm gonna close my exe file :) */
   struct file *file = cur->executable;
+  child *c = hash_children_getChild(thread_tid());
 
-  /* Destroy the current process's page directory and switch back
-     to the kernel-only page directory. */
+#ifdef VM
+  /*keep memory stats for the exit line, before teardown*/
+  if (c != NULL && cur->acct != NULL)
+    page_get_stats(cur->acct, &c->stats);
+#endif
+
+  /* Hand the current process's page directory to the reaper and
+     switch back to the kernel-only page directory. */
   pd = cur->pagedir;
   if (pd != NULL)
     {
+#ifdef VM
+      /* Write back modified pages of mapped files. */
+      mmap_destroy_all ();
+#endif
+
       /* Correct ordering here is crucial.  We must set
          cur->pagedir to NULL before switching page directories,
          so that a timer interrupt can't switch back to the
          process page directory.  We must activate the base page
-         directory before destroying the process's page
-         directory, or our active page directory will be one
+         directory before handing the process's page directory
+         to the reaper, or our active page directory will be one
          that's been freed (and cleared). */
       cur->pagedir = NULL;
       pagedir_activate (NULL);
-      pagedir_destroy (pd);
+
+      /* The executable stays open for the reaper, because frames
+         of its text are looked up by inode, but our parent may
+         write to it as soon as we are gone. */
+      if (file != NULL)
+        file_allow_write (file);
+      reap (pd, file);
+      file = NULL;
     }
 
   /*unblock calling process*/
-  child *c = hash_children_getChild(thread_tid());
   c->exit_status = cur->exit_status;
 
   sema_up(c->sema);
@@ -310,6 +509,156 @@ process_exit ()
 
 }
 
+#ifdef VM
+/* Prints each process's memory statistics when it exits if
+   ENABLE is true. */
+void
+process_set_exit_stats (bool enable)
+{
+  exit_stats = enable;
+}
+
+/* A search for the user process with the lowest pid at least
+   PID, by find_process(). */
+struct process_search
+  {
+    tid_t pid;                  /* Lowest pid wanted. */
+    struct thread *found;       /* Best process so far, or null. */
+  };
+
+/* Thread action for process_stat(). */
+static void
+find_process (struct thread *t, void *search_)
+{
+  struct process_search *search = search_;
+
+  if (t->acct != NULL && t->tid >= search->pid
+      && (search->found == NULL || t->tid < search->found->tid))
+    search->found = t;
+}
+
+/* Stores in *ST the memory statistics of the user process with
+   the lowest pid that is at least PID, and returns that pid, so
+   that every process can be visited in turn.  Returns TID_ERROR
+   if there is no such process. */
+tid_t
+process_stat (tid_t pid, struct procstat *st)
+{
+  struct process_search search;
+  enum intr_level old_level;
+  tid_t found = TID_ERROR;
+
+  search.pid = pid;
+  search.found = NULL;
+
+  /* With interrupts off, the process can't exit under us. */
+  old_level = intr_disable ();
+  thread_foreach (find_process, &search);
+  if (search.found != NULL)
+    {
+      found = search.found->tid;
+      st->pid = found;
+      strlcpy (st->name, search.found->name, sizeof st->name);
+      page_get_stats (search.found->acct, st);
+    }
+  intr_set_level (old_level);
+
+  return found;
+}
+#endif
+
+/* Hands page directory PD of the current process, along with its
+   supplemental page table and EXECUTABLE, to the reaper to be
+   freed.  Frees them right away if the reaper is not running or
+   memory allocation fails. */
+static void
+reap (uint32_t *pd, struct file *executable)
+{
+#ifdef VM
+  struct thread *cur = thread_current ();
+#endif
+  struct reap_job local;
+  struct reap_job *job = reaper_running ? malloc (sizeof *job) : NULL;
+
+  if (job == NULL)
+    job = &local;
+  job->pagedir = pd;
+  job->executable = executable;
+#ifdef VM
+  job->pages = cur->pages;
+  job->acct = cur->acct;
+  cur->acct = NULL;
+#endif
+
+  if (job == &local)
+    {
+      reap_sync_cnt++;
+      free_address_space (job);
+      return;
+    }
+
+  lock_acquire (&reap_lock);
+  list_push_back (&reap_list, &job->elem);
+  if (++reap_queued > reap_peak)
+    reap_peak = reap_queued;
+  cond_signal (&reap_ready, &reap_lock);
+  lock_release (&reap_lock);
+}
+
+/* Reaper thread.  Frees the address spaces that reap() queues. */
+static void
+reaper (void *aux UNUSED)
+{
+  for (;;)
+    {
+      struct reap_job *job;
+
+      lock_acquire (&reap_lock);
+      while (list_empty (&reap_list))
+        cond_wait (&reap_ready, &reap_lock);
+      job = list_entry (list_pop_front (&reap_list), struct reap_job, elem);
+      reap_queued--;
+      lock_release (&reap_lock);
+
+      free_address_space (job);
+      free (job);
+    }
+}
+
+/* Frees the pages, page directory and executable of JOB. */
+static void
+free_address_space (struct reap_job *job)
+{
+  int64_t start = timer_ticks ();
+  bool fs_locked;
+
+#ifdef VM
+  /* A page table whose initialization failed has no
+     accounting. */
+  if (job->acct != NULL)
+    {
+      frame_reclaim_begin ();
+      page_table_destroy (&job->pages, job->acct);
+      frame_reclaim_end ();
+    }
+#endif
+  pagedir_destroy (job->pagedir);
+
+  /* The reaper closes the executable alongside other processes'
+     system calls, so it needs the file system lock like they do.
+     A process freeing its own address space may already hold the
+     lock, if it was killed in the middle of a system call. */
+  fs_locked = !lock_held_by_current_thread (&lock_filesys);
+  if (fs_locked)
+    lock_acquire (&lock_filesys);
+  file_close (job->executable);
+  if (fs_locked)
+    lock_release (&lock_filesys);
+
+  reap_ticks += timer_elapsed (start);
+  reap_cnt++;
+}
+
 /* Sets up the CPU for running user code in the current
    thread.
    This function is called on every context switch. */
@@ -413,6 +762,11 @@ load (const child *childProcess, void (**eip) (void), void **esp)
   if (t->pagedir == NULL)
     goto done;
   process_activate ();
+#ifdef VM
+  mmap_init ();
+  if (!page_table_init (t))
+    goto done;
+#endif
 
   /* Open executable file. */
   file = filesys_open (childProcess->fname);
@@ -516,7 +870,9 @@ load (const child *childProcess, void (**eip) (void), void **esp)
 
 /* load() helpers. */
 
+#ifndef VM
 static bool install_page (void *upage, void *kpage, bool writable);
+#endif
 
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
@@ -576,6 +932,10 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
    The pages initialized by this function must be writable by the
    user process if WRITABLE is true, read-only otherwise.
 
+   With VM, the pages are only recorded in the supplemental page
+   table here, and each one is read in by the page fault handler
+   the first time it is touched.
+
    Return true if successful, false if a memory allocation error
    or disk read error occurs. */
 static bool
@@ -586,6 +946,23 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
+#ifdef VM
+  while (read_bytes > 0 || zero_bytes > 0)
+    {
+      size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
+      size_t page_zero_bytes = PGSIZE - page_read_bytes;
+
+      if (!page_add_file (upage, file, ofs, page_read_bytes, writable))
+        return false;
+
+      /* Advance. */
+      read_bytes -= page_read_bytes;
+      zero_bytes -= page_zero_bytes;
+      ofs += page_read_bytes;
+      upage += PGSIZE;
+    }
+  return true;
+#else
   file_seek (file, ofs);
   while (read_bytes > 0 || zero_bytes > 0)
     {
@@ -596,7 +973,7 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
       /* Get a page of memory. */
-      uint8_t *kpage = get_frame (PAL_USER);
+      uint8_t *kpage = palloc_get_page (PAL_USER);
       if (kpage == NULL)
         return false;
 
@@ -621,6 +998,7 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       upage += PGSIZE;
     }
   return true;
+#endif
 }
 
 /* Create a minimal stack by mapping a zeroed page at the top of
@@ -633,10 +1011,19 @@ union mem_ptr {
 static bool
 setup_stack (void **esp, const child *cp)
 {
-  uint8_t *kpage;
   bool success = false;
 
-  kpage = get_frame (PAL_USER | PAL_ZERO);
+#ifdef VM
+  uint8_t *upage = ((uint8_t *) PHYS_BASE) - PGSIZE;
+
+  success = (page_add_file (upage, NULL, 0, 0, true)
+             && page_in (upage, true));
+  if (success)
+    *esp = PHYS_BASE;
+#else
+  uint8_t *kpage;
+
+  kpage = palloc_get_page (PAL_USER | PAL_ZERO);
   if (kpage != NULL)
     {
       success = install_page (((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true);
@@ -645,6 +1032,9 @@ setup_stack (void **esp, const child *cp)
       else
         palloc_free_page (kpage);
     }
+#endif
+  if (!success)
+    return false;
 
   mp.c = (char*) PHYS_BASE - 1;
   /*@Nico: all of these variables created here can be part of child struct*/
@@ -698,6 +1088,7 @@ setup_stack (void **esp, const child *cp)
   return success;
 }
 
+#ifndef VM
 /* Adds a mapping from user virtual address UPAGE to kernel
    virtual address KPAGE to the page table.
    If WRITABLE is true, the user process may modify the page;
@@ -717,3 +1108,4 @@ install_page (void *upage, void *kpage, bool writable)
   return (pagedir_get_page (t->pagedir, upage) == NULL
           && pagedir_set_page (t->pagedir, upage, kpage, writable));
 }
+#endif
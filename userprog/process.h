@@ -3,8 +3,19 @@
 
 #include "threads/thread.h"
 
+struct intr_frame;
+
 void process_init(void);
+void process_start_reaper (void);
+void process_print_stats (void);
 tid_t process_execute (const char *prog);
+#ifdef VM
+struct procstat;
+
+tid_t process_fork (const struct intr_frame *);
+void process_set_exit_stats (bool);
+tid_t process_stat (tid_t, struct procstat *);
+#endif
 int process_wait (tid_t);
 void process_exit (void);
 void process_activate (void);
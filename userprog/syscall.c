@@ -11,11 +11,17 @@
 #include "../threads/synch.h"
 #include "../filesys/file.h"
 #include "../filesys/filesys.h"
+#include "../filesys/inode.h"
 #include "process.h"
 #include "../devices/shutdown.h"
 #include "../devices/input.h"
 #include "../threads/malloc.h"
 #include "../threads/vaddr.h"
+#include "userprog/pagedir.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
 
 #define max_param 3
 int syscall_param[max_param];
@@ -120,6 +126,38 @@ put_user_int (uint32_t *udst, uint32_t fourBytes) {
 }
 
 
+/*brings in the user page holding uaddr and keeps it in memory, so
+  that the kernel can use it while holding lock_filesys without
+  faulting; false if uaddr is not valid for the access*/
+static bool
+pin_user_page (void *uaddr, bool write) {
+#ifdef VM
+  return page_pin(uaddr, write);
+#else
+  (void) write;
+  return is_user_vaddr(uaddr)
+         && pagedir_get_page(thread_current()->pagedir, uaddr) != NULL;
+#endif
+}
+
+/*releases a page pinned by pin_user_page*/
+static void
+unpin_user_page (void *uaddr) {
+#ifdef VM
+  page_unpin(uaddr);
+#else
+  (void) uaddr;
+#endif
+}
+
+/*bytes of the user buffer at uaddr, size bytes long, that lie in
+  its first page*/
+static unsigned
+chunk_size (const void *uaddr, unsigned size) {
+  unsigned chunk = PGSIZE - pg_ofs(uaddr);
+  return chunk < size ? chunk : size;
+}
+
 static void syscall_handler (struct intr_frame *);
 
 void
@@ -151,6 +189,11 @@ static void
 syscall_handler (struct intr_frame *f UNUSED) 
 {
   int syscall_num;
+#ifdef VM
+  /* A page fault while we work on the user's behalf needs the
+     user stack pointer to tell stack growth from a bad access. */
+  thread_current ()->user_esp = f->esp;
+#endif
   if(is_user_vaddr(f->esp)) {
     if((syscall_num = get_user_int(f->esp)) == -1) {
       exit(-1);
@@ -159,7 +202,7 @@ syscall_handler (struct intr_frame *f UNUSED)
     exit(-1);
   }
 
-  if ((syscall_num > SYS_INUMBER) || (syscall_num < SYS_HALT)){
+  if ((syscall_num > SYS_FSYNC) || (syscall_num < SYS_HALT)){
     exit(-1);
   }
 
@@ -215,6 +258,31 @@ syscall_handler (struct intr_frame *f UNUSED)
       get_syscall_arg((int*)f->esp,1);
       close(syscall_param[0]);
       break;
+#ifdef VM
+    case SYS_MMAP:
+      get_syscall_arg((int*)f->esp,2);
+      f->eax = mmap(syscall_param[0],(void*)syscall_param[1]);
+      break;
+    case SYS_MUNMAP:
+      get_syscall_arg((int*)f->esp,1);
+      munmap(syscall_param[0]);
+      break;
+    case SYS_FORK:
+      f->eax = process_fork(f);
+      break;
+    case SYS_MADVISE:
+      get_syscall_arg((int*)f->esp,3);
+      f->eax = madvise((void*)syscall_param[0],(unsigned)syscall_param[1],syscall_param[2]);
+      break;
+    case SYS_PROCSTAT:
+      get_syscall_arg((int*)f->esp,2);
+      f->eax = procstat((pid_t)syscall_param[0],(struct procstat*)syscall_param[1]);
+      break;
+#endif
+    case SYS_FSYNC:
+      get_syscall_arg((int*)f->esp,1);
+      f->eax = fsync(syscall_param[0]);
+      break;
     default:
       break;
    }
@@ -354,7 +422,8 @@ int open(const char* file){
 struct file_def* find_file_def(int fd){
   for(e = list_begin(&open_file_list);e != list_end(&open_file_list);e = list_next(e))  {
     struct file_def* fp = list_entry(e,struct file_def, elem);
-      if (fd == fp->fd){
+      /*a forked child has its own file_def under its parent's fd*/
+      if (fd == fp->fd && fp->tid == thread_current()->tid){
         return fp; 
     }
   }
@@ -374,60 +443,73 @@ int filesize(int fd){
   return length;
 }
 
+/*reads one page-sized chunk at a time, with the chunk's page pinned
+  before lock_filesys is taken, so that the copy never faults while
+  the lock is held*/
 int read(int fd, void* buffer,unsigned size){
-  int32_t retval;
+  uint8_t *udst = (uint8_t *)buffer;
+  int32_t total = 0;
   if (size == 0) return 0;
   check_user_ptr(buffer);
-  lock_acquire(&lock_filesys);
-  /*read from keyboard*/
-  if (fd == 0){
-    uint8_t *buffer_ = (uint8_t *)buffer;
-    unsigned int i;
-    for (i=0;i<size;i++){
-      *(buffer_+i) = input_getc();
+  while (size > 0){
+    unsigned chunk = chunk_size(udst, size);
+    int32_t retval = 0;
+
+    if (!pin_user_page(udst, true)) exit(-1);
+    lock_acquire(&lock_filesys);
+    /*read from keyboard*/
+    if (fd == 0){
+      unsigned int i;
+      for (i=0;i<chunk;i++){
+        *(udst+i) = input_getc();
+      }
+      retval = chunk;
+    } else {
+      struct file_def* fp = find_file_def(fd);
+      if (fp != NULL)
+        retval = (int32_t)file_read(fp->opened_file,udst,chunk);
     }
     lock_release(&lock_filesys);
-    return size;
-  }
-  struct file_def* fp = find_file_def(fd);
-   if (fp == NULL){
-    lock_release(&lock_filesys);
-    return 0;
-  }
-  retval = (int32_t)file_read(fp->opened_file,buffer,size);
+    unpin_user_page(udst);
 
-  lock_release(&lock_filesys);
-  return retval;
+    total += retval;
+    if (retval < (int32_t)chunk) break;
+    udst += chunk;
+    size -= chunk;
+  }
+  return total;
 }
 
+/*writes one page-sized chunk at a time, pinned like in read*/
 int write(int fd, const void* buffer, unsigned size){
-  int32_t retval;
-  unsigned counter = 0;
+  uint8_t *usrc = (uint8_t *)buffer;
+  int32_t total = 0;
   if (size == 0) {return 0;}
   check_user_ptr(buffer);
-  lock_acquire(&lock_filesys);
-  /*write to console*/
-  if (size == 0) return 0;
-  if (fd == 1){
-    /*call putbuf to putbuf()*/
-    while(size > 512){
-      putbuf((char*)buffer+counter,512);
-      counter = counter + 512;
-      size = size - 512;
+  while (size > 0){
+    unsigned chunk = chunk_size(usrc, size);
+    int32_t retval = 0;
+
+    if (!pin_user_page(usrc, false)) exit(-1);
+    lock_acquire(&lock_filesys);
+    /*write to console*/
+    if (fd == 1){
+      putbuf((char*)usrc,chunk);
+      retval = chunk;
+    } else {
+      struct file_def* fp = find_file_def(fd);
+      if (fp != NULL)
+        retval = (int32_t)file_write(fp->opened_file,usrc,chunk);
     }
-    putbuf((char*)buffer,size);
     lock_release(&lock_filesys);
-    return size;
-  }
-  struct file_def* fp = find_file_def(fd);
-   if (fp == NULL){
-    lock_release(&lock_filesys);
-    return 0;
+    unpin_user_page(usrc);
+
+    total += retval;
+    if (retval < (int32_t)chunk) break;
+    usrc += chunk;
+    size -= chunk;
   }
-   retval = (int32_t)file_write(fp->opened_file,buffer,size);
-  lock_release(&lock_filesys);
-  
-  return retval;
+  return total;
 }
 
 void seek(int fd, unsigned position){
@@ -455,6 +537,20 @@ unsigned tell(int fd){
   return pos;
 }
 
+/*writes the file's modified data and inode out of the buffer cache
+  to disk; returns 0 if successful, -1 if fd is not open*/
+int fsync(int fd){
+  lock_acquire(&lock_filesys);
+  struct file_def* fp = find_file_def(fd);
+  if (fp == NULL){
+    lock_release(&lock_filesys);
+    return -1;
+  }
+  inode_flush(file_get_inode(fp->opened_file));
+  lock_release(&lock_filesys);
+  return 0;
+}
+
 void close(int fd){
   lock_acquire(&lock_filesys);
   if ((fd==0) || (fd==1)) exit(-1);
@@ -480,3 +576,87 @@ void close(int fd){
 
   lock_release(&lock_filesys);
 }
+
+#ifdef VM
+/*maps the file open as fd into memory at addr, on its own reopened
+  file so that the mapping outlives close(fd)*/
+mapid_t mmap(int fd, void *addr){
+  struct file *file = NULL;
+
+  lock_acquire(&lock_filesys);
+  struct file_def* fp = find_file_def(fd);
+  if (fp != NULL && fp->tid == thread_current()->tid)
+    file = file_reopen(fp->opened_file);
+  lock_release(&lock_filesys);
+
+  if (file == NULL) return MAP_FAILED;
+  return mmap_create(file, addr);
+}
+
+void munmap(mapid_t mapping){
+  mmap_destroy(mapping);
+}
+
+/*applies advice to the pages of [addr, addr + len); returns 0 if
+  successful, -1 if the range or the advice is bad*/
+int madvise(void *addr, unsigned len, int advice){
+  if (advice < MADV_NORMAL || advice > MADV_DONTNEED) return -1;
+  return page_advise(addr, len, advice) ? 0 : -1;
+}
+
+/*stores the memory stats of the process with the lowest pid that is
+  at least pid in *st; returns that pid, or -1 if there is none*/
+pid_t procstat(pid_t pid, struct procstat *st){
+  struct procstat kst;
+  uint8_t *src = (uint8_t*) &kst;
+  uint8_t *dst = (uint8_t*) st;
+  unsigned i;
+  pid_t ret = process_stat(pid, &kst);
+
+  if (ret == TID_ERROR) return -1;
+  for (i = 0; i < sizeof kst; i++) {
+    if (!is_user_vaddr(dst + i) || !put_user_byte(dst + i, src[i]))
+      exit(-1);
+  }
+  return ret;
+}
+
+/*gives the current process, just forked from parent, its own copy
+  of every file the parent has open, under the same fd and at the
+  same position; returns false if memory runs out*/
+bool syscall_inherit_files(tid_t parent){
+  struct list_elem *it;
+  bool success = true;
+
+  lock_acquire(&lock_filesys);
+  for(it = list_begin(&open_file_list);it != list_end(&open_file_list);it = list_next(it))  {
+    struct file_def* fp = list_entry(it,struct file_def, elem);
+    if (fp->tid != parent) continue;
+
+    struct file_def *copy = (struct file_def*)malloc(sizeof(struct file_def));
+    if (copy == NULL) {
+      success = false;
+      break;
+    }
+    copy->file_str = (char*) malloc(15);
+    copy->opened_file = file_reopen(fp->opened_file);
+    if (copy->file_str == NULL || copy->opened_file == NULL) {
+      file_close(copy->opened_file);
+      free(copy->file_str);
+      free(copy);
+      success = false;
+      break;
+    }
+    memcpy(copy->file_str, fp->file_str, 15);
+    file_seek(copy->opened_file, file_tell(fp->opened_file));
+    copy->hash_num = fp->hash_num;
+    copy->fd = fp->fd;
+    copy->tid = thread_current()->tid;
+
+    /*lands behind the parent's entries, so the loop skips it*/
+    list_push_back(&open_file_list,&(copy->elem));
+  }
+  lock_release(&lock_filesys);
+  return success;
+}
+#endif
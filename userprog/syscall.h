@@ -1,6 +1,11 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Serializes all file system access. */
+extern struct lock lock_filesys;
 
 typedef int pid_t;
 
@@ -28,4 +33,21 @@ unsigned tell(int fd);
 
 
 void close(int fd);
+
+int fsync(int fd);
+
+#ifdef VM
+#include "vm/mmap.h"
+
+mapid_t mmap(int fd, void *addr);
+
+void munmap(mapid_t mapping);
+
+int madvise(void *addr, unsigned len, int advice);
+
+struct procstat;
+pid_t procstat(pid_t pid, struct procstat *st);
+
+bool syscall_inherit_files(tid_t parent);
+#endif
 #endif /* userprog/syscall.h */
\ No newline at end of file
@@ -1,107 +1,1218 @@
-#include "frame.h"
+#include "vm/frame.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/page.h"
+#include "vm/swap.h"
 
-struct lock frame_lock;
+/* Frame table.
 
-static struct list frame_list;
-static list_elem e;
-static frame *cur_frame_ptr;
+   At boot the frame table takes over the whole user pool from
+   palloc as one contiguous block, so the frame for a kernel
+   virtual address KPAGE is simply
+   frames[(KPAGE - user_pool_base) / PGSIZE].  Free frames are
+   threaded onto a singly linked free list through the frames
+   themselves, so allocation, lookup and release are all O(1).
 
+   When the free list is empty, get_frame() evicts the page in a
+   frame chosen by the replacement policy, writing it to swap if
+   it is dirty, together with other dirty victims.  A frame is
+   "locked" while it is being filled or evicted, which keeps the
+   policy away from it and makes anyone who faults on its page
+   wait for the eviction to finish.  A frame is "pinned" while a
+   system call uses its page as a buffer, which also keeps the
+   policy away from it, so that the kernel can touch the buffer
+   without faulting while it holds the file system lock.
 
-void frame_init(void){
-  struct frame* frame_ptr;
-  void* page_addr;
+   Frames of read-only executable text are entered in a hash
+   table keyed by (inode, offset), so that other processes
+   running the same program can map the same frame instead of
+   reading their own copy.  fork() shares the parent's frames
+   with the child through frame_add_page(), and a write to such a
+   frame takes its page out with frame_remove_page() and gives it
+   a copy of its own.
 
-  list_init(&frame_list);
-  lock_init(&frame_lock);
+   The optional merging thread does the same for pages that
+   merely happen to be identical, like KSM in Linux.  It sweeps
+   the frame table slowly, checksumming each frame of ordinary
+   writable memory.  A frame whose checksum has not changed since
+   the last sweep is considered stable, and is looked up by
+   checksum first among frames already merged and then among the
+   other stable frames seen in this sweep.  If memcmp() confirms a
+   match, the frame's pages are moved, read-only, to the other
+   frame, and the frame is freed.  Writes then go through the same
+   copy-on-write path as after fork().
 
-  while((page_addr = palloc_get_page(PAL_USER))){ /*acquire all available frames*/
-    frame_ptr = (struct frame*) malloc(sizeof(struct frame));
-    if (frame_ptr == NULL) return;
-    frame_ptr->page_addr = page_addr;
-    frame_ptr->LRU_bit = 0;
-    frame_ptr->valid = 0;
-    lock_init(frame_ptr->pages_lock);
-    lock_acquire(frame_lock);
-    list_push_back(&frame_list,&frame_ptr->list_elem);
-    lock_release(frame_lock);
-  }
+   frame_lock protects the free list, the shared frames table,
+   every frame's `page', `locked', `pin_cnt' and sharing members,
+   and the `kpage', `evicted' and `next_sharer' members of the
+   pages in frames. */
 
+static struct lock frame_lock;          /* Protects the frame table. */
+static struct condition frame_unlocked; /* Signaled when a frame unlocks. */
+static uint8_t *user_pool_base;         /* Kernel address of frame 0. */
+static size_t frame_cnt;                /* Number of frames. */
+static struct frame *frames;            /* Frame table. */
+static struct frame *free_frames;       /* Head of the free list. */
+static size_t free_cnt;                 /* Number of frames on the list. */
+static struct hash shared_frames;       /* Frames of shared text. */
+static struct hash merged_frames;       /* Frames shared by merging. */
+static struct hash unstable_frames;     /* Merge candidates this sweep. */
 
+/* Pager thread.
+
+   The pager wakes up when an allocation leaves fewer than
+   pager_low frames free, and evicts pages until pager_high
+   frames are free, so that page faults rarely have to wait for
+   an eviction themselves.  A watermark of 0 means to use a
+   default proportional to the number of frames. */
+static size_t pager_low;                /* Wake up below this many. */
+static size_t pager_high;               /* Sleep at this many. */
+static struct condition pager_wake;     /* Signaled to wake the pager. */
+static bool pager_running;              /* Has pager thread started? */
+
+/* Merging thread. */
+static size_t merge_rate;               /* Frames to scan per second. */
+static size_t merge_hand;               /* Next frame to scan. */
+
+/* Number of threads releasing frames in bulk, e.g. the reaper
+   tearing down the address space of an exited process. */
+static int reclaim_cnt;
+
+/* Statistics. */
+static long long evict_cnt;             /* # of pages evicted. */
+static long long writeback_cnt;         /* # of evicted pages that were dirty. */
+static long long refault_cnt;           /* # of faults on evicted pages. */
+static long long alloc_cnt;             /* # of frames allocated. */
+static long long direct_cnt;            /* # that had to evict first. */
+static long long pager_wakeups;         /* # of times the pager ran. */
+static long long pager_freed;           /* # of frames freed by pager. */
+static int64_t pager_ticks;             /* Ticks spent by the pager. */
+static long long share_cnt;             /* # of faults on shared frames. */
+static long long merge_scan_cnt;        /* # of frames scanned. */
+static long long merge_cnt;             /* # of pages merged. */
+static long long reclaim_yields;        /* # of waits for the reaper. */
+static long long reclaim_hits;          /* # that got a frame from it. */
+
+/* A page replacement policy. */
+struct frame_policy
+  {
+    const char *name;                   /* Name for -evict option. */
+    struct frame *(*victim) (void);     /* Chooses a frame to evict. */
+    void (*age) (void);                 /* Periodic sweep, or null. */
+  };
+
+static struct frame *clock_victim (void);
+static struct frame *aging_victim (void);
+static void aging_sweep (void);
+static struct frame *wsclock_victim (void);
+
+/* Supported policies.  The first one is the default. */
+static const struct frame_policy policies[] =
+  {
+    {"clock", clock_victim, NULL},
+    {"aging", aging_victim, aging_sweep},
+    {"wsclock", wsclock_victim, NULL},
+  };
+
+/* Policy in use. */
+static const struct frame_policy *policy = &policies[0];
+
+static struct frame *evict (size_t *freed);
+static void account_resident (struct page *, int delta);
+static void bind_frame (struct frame *, struct page *);
+static void unlink_page (struct frame *, struct page *);
+static void push_free (struct frame *);
+static void unpublish (struct frame *);
+static unsigned share_hash (const struct hash_elem *, void *);
+static bool share_less (const struct hash_elem *, const struct hash_elem *,
+                        void *);
+static unsigned merge_hash (const struct hash_elem *, void *);
+static bool merge_less (const struct hash_elem *, const struct hash_elem *,
+                        void *);
+static void merger (void *aux);
+static struct frame *pop_free (void);
+static void pager (void *aux);
+static void ager (void *aux);
+static void *frame_kpage (const struct frame *);
+
+/* Initializes the frame table, taking every page in the user
+   pool. */
+void
+frame_init (void)
+{
+  size_t i;
+
+  lock_init (&frame_lock);
+  cond_init (&frame_unlocked);
+  cond_init (&pager_wake);
+
+  frame_cnt = palloc_user_pool_size ();
+  user_pool_base = palloc_get_multiple (PAL_USER | PAL_ASSERT, frame_cnt);
+  frames = calloc (frame_cnt, sizeof *frames);
+  if ((frames == NULL && frame_cnt > 0)
+      || !hash_init (&shared_frames, share_hash, share_less, NULL)
+      || !hash_init (&merged_frames, merge_hash, merge_less, NULL)
+      || !hash_init (&unstable_frames, merge_hash, merge_less, NULL))
+    PANIC ("frame_init: cannot allocate frame table");
+
+  /* Thread the free list in address order. */
+  free_frames = NULL;
+  for (i = frame_cnt; i-- > 0; )
+    push_free (&frames[i]);
+
+  if (pager_low == 0)
+    pager_low = frame_cnt / 64 + 1;
+  if (pager_high == 0)
+    pager_high = pager_low * 4;
+  if (pager_high > frame_cnt / 2)
+    pager_high = frame_cnt / 2;
+  if (pager_low > pager_high)
+    pager_low = pager_high;
+
+  printf ("%zu frames in frame table (%zu bytes), %s replacement.\n",
+          frame_cnt, frame_cnt * sizeof *frames, policy->name);
+}
+
+/* Sets the pager's low and high free frame watermarks.  Must be
+   called before frame_init().  A value of 0 selects the
+   default. */
+void
+frame_set_watermarks (size_t low, size_t high)
+{
+  pager_low = low;
+  pager_high = high;
+}
+
+/* Starts the pager thread, and the aging thread if the policy
+   needs one.  Call after the swap device has been set up, since
+   the pager may write pages to swap. */
+void
+frame_start_pager (void)
+{
+  if (pager_high > 0)
+    {
+      pager_running = true;
+      thread_create ("pager", PRI_DEFAULT, pager, NULL);
+    }
+  if (policy->age != NULL && frame_cnt > 0)
+    thread_create ("ager", PRI_DEFAULT, ager, NULL);
+}
+
+/* Makes the merging thread scan PAGES_PER_SEC frames per second
+   for pages to merge.  0, the default, disables merging.  Must
+   be called before frame_start_merger(). */
+void
+frame_set_merge_rate (size_t pages_per_sec)
+{
+  merge_rate = pages_per_sec;
 }
 
-void* get_frame(void){
+/* Starts the merging thread, if merging is enabled.  It runs at
+   the lowest priority, since it only saves memory. */
+void
+frame_start_merger (void)
+{
+  if (merge_rate > 0 && frame_cnt > 0)
+    thread_create ("merger", PRI_MIN, merger, NULL);
+}
+
+/* Selects the page replacement policy called NAME.
+   Returns false if there is no such policy. */
+bool
+frame_set_policy (const char *name)
+{
+  size_t i;
 
-  lock_acquire(frame_lock);
+  for (i = 0; i < sizeof policies / sizeof *policies; i++)
+    if (name != NULL && !strcmp (name, policies[i].name))
+      {
+        policy = &policies[i];
+        return true;
+      }
+  return false;
+}
 
-  for(e = list_begin(&frame_list); e!= list_end(&frame_ist); e = list_next(e)){
-    struct frame* fp = list_entry(e, struct frame, list_elem);
-    if (!fp->valid){ /* current frame not inuse*/
-      fp->valid = true;
-      lock_release(frame_lock);
-      return fp->page_addr;
+/* Prints frame table statistics. */
+void
+frame_print_stats (void)
+{
+  printf ("Frames: %lld evictions, %lld dirty write-backs, "
+          "%lld refaults (%lld%% of evictions)\n",
+          evict_cnt, writeback_cnt, refault_cnt,
+          evict_cnt > 0 ? refault_cnt * 100 / evict_cnt : 0);
+  printf ("Pager: %zu/%zu watermarks, %lld wakeups, %lld frames freed "
+          "in %"PRId64" ticks, %lld of %lld allocations had to evict\n",
+          pager_low, pager_high, pager_wakeups, pager_freed, pager_ticks,
+          direct_cnt, alloc_cnt);
+  if (reclaim_yields > 0)
+    printf ("Frames: %lld allocations yielded to the reaper, "
+            "%lld got a frame it freed\n", reclaim_yields, reclaim_hits);
+  printf ("Frames: %zu frames of shared text, %lld faults served by them\n",
+          hash_size (&shared_frames), share_cnt);
+  if (merge_rate > 0)
+    {
+      struct hash_iterator i;
+      size_t saved = 0;
+
+      hash_first (&i, &merged_frames);
+      while (hash_next (&i))
+        saved += hash_entry (hash_cur (&i), struct frame,
+                             share_elem)->ref_cnt - 1;
+      printf ("Merging: %lld frames scanned, %lld pages merged, "
+              "%zu frames (%zu kB) saved\n",
+              merge_scan_cnt, merge_cnt, saved, saved * PGSIZE / 1024);
+    }
+}
+
+/* Obtains a user frame to hold page P and returns its kernel
+   virtual address, evicting another page if no frame is free.
+   The frame is zeroed if FLAGS includes PAL_ZERO.  Returns a
+   null pointer if no frame can be had, or panics instead if
+   FLAGS includes PAL_ASSERT.
+
+   If no frame is free while frames are being released in bulk,
+   first yields the CPU once, so that a frame about to be freed
+   is taken instead of evicting a page still in use.  It waits no
+   longer than that, because the frames being released may be
+   locked by the caller.
+
+   The frame is returned locked, so it will not be evicted before
+   the caller has filled it, mapped P to it, and called
+   frame_unlock(). */
+void *
+get_frame (enum palloc_flags flags, struct page *p)
+{
+  struct frame *f;
+  void *kpage;
+
+  lock_acquire (&frame_lock);
+  alloc_cnt++;
+  f = pop_free ();
+  if (f == NULL && reclaim_cnt > 0)
+    {
+      reclaim_yields++;
+      lock_release (&frame_lock);
+      thread_yield ();
+      lock_acquire (&frame_lock);
+      f = pop_free ();
+      if (f != NULL)
+        reclaim_hits++;
+    }
+  if (f == NULL)
+    {
+      direct_cnt++;
+      f = evict (NULL);
+    }
+  if (pager_running && free_cnt < pager_low)
+    cond_signal (&pager_wake, &frame_lock);
+  if (f != NULL)
+    {
+      bind_frame (f, p);
+      if (p->evicted)
+        refault_cnt++;
+    }
+  lock_release (&frame_lock);
+
+  if (f == NULL)
+    {
+      if (flags & PAL_ASSERT)
+        PANIC ("get_frame: out of frames");
+      return NULL;
+    }
+
+  kpage = frame_kpage (f);
+  if (flags & PAL_ZERO)
+    memset (kpage, 0, PGSIZE);
+  return kpage;
+}
+
+/* Tells get_frame() that the caller is about to release many
+   frames, until it calls frame_reclaim_end(). */
+void
+frame_reclaim_begin (void)
+{
+  lock_acquire (&frame_lock);
+  reclaim_cnt++;
+  lock_release (&frame_lock);
+}
+
+/* Ends a frame_reclaim_begin(). */
+void
+frame_reclaim_end (void)
+{
+  lock_acquire (&frame_lock);
+  ASSERT (reclaim_cnt > 0);
+  reclaim_cnt--;
+  lock_release (&frame_lock);
+}
+
+/* Like get_frame(), but for speculative uses such as read-ahead:
+   never evicts, and returns a null pointer unless more frames
+   are free than the pager's low watermark. */
+void *
+get_free_frame (struct page *p)
+{
+  struct frame *f = NULL;
+
+  lock_acquire (&frame_lock);
+  if (free_cnt > pager_low)
+    {
+      f = pop_free ();
+      bind_frame (f, p);
     }
-  }
-    /*
-    lock_release(frame_lock);
-    evict_frame();
-    return get_frame(flag);*/
+  lock_release (&frame_lock);
 
+  return f != NULL ? frame_kpage (f) : NULL;
 }
 
-void free_frame(void* pa) {
-  lock_acquire(frame_lock);
-  struct frame* fp = find_frame(pa);
-  if (fp == NULL) return;
-  fp->valid = false;
-  lock_release(frame_lock);
+/* Unlocks frame KPAGE, locked by get_frame() or
+   frame_lock_page(), making its page a candidate for eviction. */
+void
+frame_unlock (void *kpage)
+{
+  struct frame *f = find_frame (kpage);
+
+  ASSERT (f != NULL && f->locked);
+
+  lock_acquire (&frame_lock);
+  f->locked = false;
+  cond_broadcast (&frame_unlocked, &frame_lock);
+  lock_release (&frame_lock);
 }
 
-struct frame* find_frame(void* pa){
-  for(e = list_begin(&frame_list); e != list_end(&frame_list); e = list_next(e)) {
-    struct frame * fp = list_entry(e, struct frame, list_elem);
-    if ((fp->page_addr == pa) && fp->valid) {
-      return fp;
+/* Returns frame KPAGE, locked by get_frame() or
+   frame_lock_page(), to the free list.  The page in the frame, if
+   any, is no longer resident. */
+void
+free_frame (void *kpage)
+{
+  struct frame *f = find_frame (kpage);
+
+  ASSERT (f != NULL && f->locked);
+
+  lock_acquire (&frame_lock);
+  if (f->page != NULL)
+    {
+      f->page->kpage = NULL;
+      account_resident (f->page, -1);
+    }
+  unpublish (f);
+  f->page = NULL;
+  f->ref_cnt = 0;
+  f->locked = false;
+  push_free (f);
+  cond_broadcast (&frame_unlocked, &frame_lock);
+  lock_release (&frame_lock);
+}
+
+/* If page P is resident, waits for any eviction in progress to
+   finish, then locks P's frame and returns its kernel virtual
+   address.  Returns a null pointer if P is not resident. */
+void *
+frame_lock_page (struct page *p)
+{
+  void *kpage;
+
+  lock_acquire (&frame_lock);
+  while (p->kpage != NULL && find_frame (p->kpage)->locked)
+    cond_wait (&frame_unlocked, &frame_lock);
+  kpage = p->kpage;
+  if (kpage != NULL)
+    find_frame (kpage)->locked = true;
+  lock_release (&frame_lock);
+
+  return kpage;
+}
+
+/* Looks for a frame of shared text holding the page at offset
+   OFS in the file with the given INODE.  If there is one, adds
+   page P to the pages mapped to it, locks it, and returns its
+   kernel virtual address.  The caller must then map P to it and
+   call frame_unlock(), or frame_release_page() on failure.
+   Otherwise, returns a null pointer. */
+void *
+frame_share (struct page *p, struct inode *inode, off_t ofs)
+{
+  struct frame key;
+  struct frame *f = NULL;
+
+  key.inode = inode;
+  key.inode_ofs = ofs;
+
+  lock_acquire (&frame_lock);
+  for (;;)
+    {
+      struct hash_elem *e = hash_find (&shared_frames, &key.share_elem);
+      if (e == NULL)
+        break;
+
+      f = hash_entry (e, struct frame, share_elem);
+      if (!f->locked)
+        {
+          f->locked = true;
+          p->next_sharer = f->page;
+          f->page = p;
+          f->ref_cnt++;
+          p->kpage = frame_kpage (f);
+          account_resident (p, 1);
+          share_cnt++;
+          break;
+        }
+
+      /* Still being read in, or being evicted.  Look again once
+         it settles. */
+      f = NULL;
+      cond_wait (&frame_unlocked, &frame_lock);
+    }
+  lock_release (&frame_lock);
+
+  return f != NULL ? frame_kpage (f) : NULL;
+}
+
+/* Makes frame KPAGE, locked by get_frame() and holding the page
+   at offset OFS in the file with the given INODE, available to
+   frame_share().  Does nothing if another frame already holds
+   that page. */
+void
+frame_publish (void *kpage, struct inode *inode, off_t ofs)
+{
+  struct frame *f = find_frame (kpage);
+
+  ASSERT (f != NULL && f->locked);
+
+  lock_acquire (&frame_lock);
+  f->inode = inode;
+  f->inode_ofs = ofs;
+  if (hash_insert (&shared_frames, &f->share_elem) == NULL)
+    f->table = &shared_frames;
+  else
+    f->inode = NULL;
+  lock_release (&frame_lock);
+}
+
+/* Removes page P from frame KPAGE, which the caller must have
+   locked with frame_lock_page(), and unlocks the frame.  The
+   frame is freed once no pages remain in it. */
+void
+frame_release_page (void *kpage, struct page *p)
+{
+  struct frame *f = find_frame (kpage);
+
+  ASSERT (f != NULL && f->locked);
+
+  lock_acquire (&frame_lock);
+  unlink_page (f, p);
+  f->locked = false;
+  if (f->page == NULL)
+    {
+      unpublish (f);
+      push_free (f);
+    }
+  cond_broadcast (&frame_unlocked, &frame_lock);
+  lock_release (&frame_lock);
+}
+
+/* Adds page P, which is not resident, to the pages held in frame
+   KPAGE, which the caller must have locked.  The caller must map
+   P to the frame itself. */
+void
+frame_add_page (void *kpage, struct page *p)
+{
+  struct frame *f = find_frame (kpage);
+
+  ASSERT (f != NULL && f->locked);
+  ASSERT (p->kpage == NULL);
+
+  lock_acquire (&frame_lock);
+  p->next_sharer = f->page;
+  f->page = p;
+  f->ref_cnt++;
+  p->kpage = kpage;
+  account_resident (p, 1);
+  lock_release (&frame_lock);
+}
+
+/* Removes page P from frame KPAGE, which the caller must have
+   locked and which must hold other pages as well.  Unlike
+   frame_release_page(), leaves the frame locked. */
+void
+frame_remove_page (void *kpage, struct page *p)
+{
+  struct frame *f = find_frame (kpage);
+
+  ASSERT (f != NULL && f->locked);
+  ASSERT (f->ref_cnt > 1);
+
+  lock_acquire (&frame_lock);
+  unlink_page (f, p);
+  lock_release (&frame_lock);
+}
+
+/* Returns true if frame KPAGE, which the caller must have
+   locked, holds only one page, which may then be made writable
+   in place instead of being copied.  Takes the frame out of the
+   merging tables, since its contents are about to change. */
+bool
+frame_make_private (void *kpage)
+{
+  struct frame *f = find_frame (kpage);
+  bool private;
+
+  ASSERT (f != NULL && f->locked);
+
+  lock_acquire (&frame_lock);
+  private = f->ref_cnt == 1;
+  if (private)
+    unpublish (f);
+  lock_release (&frame_lock);
+
+  return private;
+}
+
+/* Waits until page P is not being evicted.  Returns true if P is
+   resident afterward, false if it is not in any frame. */
+bool
+frame_wait (struct page *p)
+{
+  bool resident;
+
+  lock_acquire (&frame_lock);
+  while (p->kpage != NULL && find_frame (p->kpage)->locked)
+    cond_wait (&frame_unlocked, &frame_lock);
+  resident = p->kpage != NULL;
+  lock_release (&frame_lock);
+
+  return resident;
+}
+
+/* Pins the frame of page P, if P is resident, so that it is not
+   evicted until frame_unpin().  Waits for any eviction in
+   progress to finish first.  Returns true if successful, false
+   if P is not resident. */
+bool
+frame_pin (struct page *p)
+{
+  bool pinned;
+
+  lock_acquire (&frame_lock);
+  while (p->kpage != NULL && find_frame (p->kpage)->locked)
+    cond_wait (&frame_unlocked, &frame_lock);
+  pinned = p->kpage != NULL;
+  if (pinned)
+    {
+      struct frame *f = find_frame (p->kpage);
+      ASSERT (f->pin_cnt < UINT8_MAX);
+      f->pin_cnt++;
+    }
+  lock_release (&frame_lock);
+
+  return pinned;
+}
+
+/* Unpins the frame of page P, pinned by frame_pin(). */
+void
+frame_unpin (struct page *p)
+{
+  struct frame *f;
+
+  lock_acquire (&frame_lock);
+  f = find_frame (p->kpage);
+  ASSERT (f != NULL && f->pin_cnt > 0);
+  f->pin_cnt--;
+  lock_release (&frame_lock);
+}
+
+/* Returns the frame table entry for the user frame at kernel
+   virtual address KPAGE, or a null pointer if KPAGE is not in
+   the user pool. */
+struct frame *
+find_frame (const void *kpage)
+{
+  size_t idx;
+
+  if ((const uint8_t *) kpage < user_pool_base)
+    return NULL;
+  idx = pg_no (kpage) - pg_no (user_pool_base);
+  return idx < frame_cnt ? &frames[idx] : NULL;
+}
+
+/* Chooses frames to evict with the replacement policy, locks
+   them, and stores them in VICTIMS, which must have room for
+   SWAP_CLUSTER frames.  If the first victim's page is dirty, and
+   so must be written to swap, picks more dirty victims to write
+   out along with it, since a run of pages costs little more to
+   write than one page.  Clean frames passed over meanwhile are
+   locked too until the end, so that a policy such as aging,
+   which would otherwise pick the same frame again, moves on.
+   Returns the number of victims. */
+static size_t
+pick_victims (struct frame *victims[])
+{
+  struct frame *skipped[2 * SWAP_CLUSTER];
+  size_t skip_cnt = 0;
+  size_t cnt = 0;
+  size_t try;
+
+  victims[0] = policy->victim ();
+  if (victims[0] == NULL)
+    return 0;
+  victims[cnt++]->locked = true;
+
+  if (page_is_dirty (victims[0]->page))
+    for (try = 0; try < 2 * SWAP_CLUSTER && cnt < SWAP_CLUSTER; try++)
+      {
+        struct frame *f = policy->victim ();
+        if (f == NULL)
+          break;
+        f->locked = true;
+        if (page_is_dirty (f->page))
+          victims[cnt++] = f;
+        else
+          skipped[skip_cnt++] = f;
+      }
+
+  /* No one can be waiting for the skipped frames, since we have
+     held frame_lock all along. */
+  while (skip_cnt > 0)
+    skipped[--skip_cnt]->locked = false;
+  return cnt;
+}
+
+/* Evicts pages in frames chosen by the replacement policy and
+   returns one of the emptied frames, putting any others on the
+   free list.  If FREED is nonnull, adds the number of frames
+   emptied to *FREED.  Returns a null pointer if no page could be
+   evicted.  Must be called with frame_lock held, which is
+   released while pages are being written out. */
+static struct frame *
+evict (size_t *freed)
+{
+  size_t try;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  for (try = 0; try < frame_cnt; try++)
+    {
+      struct frame *victims[SWAP_CLUSTER];
+      struct page *pages[SWAP_CLUSTER];
+      bool evicted[SWAP_CLUSTER];
+      struct frame *free = NULL;
+      size_t cnt, written;
+      size_t i;
+
+      cnt = pick_victims (victims);
+      if (cnt == 0)
+        return NULL;
+      for (i = 0; i < cnt; i++)
+        pages[i] = victims[i]->page;
+
+      lock_release (&frame_lock);
+      written = page_out (pages, cnt, evicted);
+      lock_acquire (&frame_lock);
+
+      writeback_cnt += written;
+      for (i = 0; i < cnt; i++)
+        {
+          struct frame *f = victims[i];
+          struct page *p;
+
+          f->locked = false;
+          if (!evicted[i])
+            continue;
+
+          for (p = f->page; p != NULL; p = p->next_sharer)
+            {
+              p->kpage = NULL;
+              p->evicted = true;
+              account_resident (p, -1);
+            }
+          unpublish (f);
+          f->page = NULL;
+          f->ref_cnt = 0;
+          evict_cnt++;
+          if (freed != NULL)
+            ++*freed;
+          if (free == NULL)
+            free = f;
+          else
+            push_free (f);
+        }
+      cond_broadcast (&frame_unlocked, &frame_lock);
+      if (free != NULL)
+        return free;
+    }
+  return NULL;
+}
+
+/* Makes free frame F hold page P, and locks it. */
+static void
+bind_frame (struct frame *f, struct page *p)
+{
+  p->next_sharer = NULL;
+  f->page = p;
+  f->ref_cnt = 1;
+  account_resident (p, 1);
+  f->pin_cnt = 0;
+  f->locked = true;
+  f->age = 0;
+  f->last_used = timer_ticks ();
+}
+
+/* Removes page P from the pages held in frame F.  Must be called
+   with frame_lock held. */
+static void
+unlink_page (struct frame *f, struct page *p)
+{
+  struct page **pp;
+
+  for (pp = &f->page; *pp != p; pp = &(*pp)->next_sharer)
+    ASSERT (*pp != NULL);
+  *pp = p->next_sharer;
+  p->next_sharer = NULL;
+  p->kpage = NULL;
+  f->ref_cnt--;
+  account_resident (p, -1);
+}
+
+/* Adds DELTA to the resident set of P's owner.  Must be called
+   with frame_lock held. */
+static void
+account_resident (struct page *p, int delta)
+{
+  struct page_acct *acct = p->owner;
+
+  acct->rss += delta;
+  if (p->type == PAGE_MMAP)
+    acct->mmap_rss += delta;
+  if (acct->rss > acct->peak_rss)
+    acct->peak_rss = acct->rss;
+}
+
+/* Removes F from the shared frames table or the merging table
+   that it is in, if any. */
+static void
+unpublish (struct frame *f)
+{
+  if (f->table != NULL)
+    {
+      hash_delete (f->table, &f->share_elem);
+      f->table = NULL;
+      f->inode = NULL;
+    }
+}
+
+/* Returns a hash value for shared frame E. */
+static unsigned
+share_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct frame *f = hash_entry (e, struct frame, share_elem);
+  return hash_bytes (&f->inode, sizeof f->inode) ^ hash_int (f->inode_ofs);
+}
+
+/* Returns true if shared frame A precedes shared frame B. */
+static bool
+share_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct frame *a = hash_entry (a_, struct frame, share_elem);
+  const struct frame *b = hash_entry (b_, struct frame, share_elem);
+
+  if (a->inode != b->inode)
+    return a->inode < b->inode;
+  return a->inode_ofs < b->inode_ofs;
+}
+
+/* Returns a hash value for merge candidate E. */
+static unsigned
+merge_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_entry (e, struct frame, share_elem)->checksum;
+}
+
+/* Returns true if merge candidate A precedes merge candidate B.
+   Frames with the same checksum compare equal, which is how a
+   candidate finds its likely twin. */
+static bool
+merge_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct frame *a = hash_entry (a_, struct frame, share_elem);
+  const struct frame *b = hash_entry (b_, struct frame, share_elem);
+
+  return a->checksum < b->checksum;
+}
+
+/* Adds F to the free list. */
+static void
+push_free (struct frame *f)
+{
+  f->next_free = free_frames;
+  free_frames = f;
+  free_cnt++;
+}
+
+/* Removes and returns a frame from the free list, or returns a
+   null pointer if the list is empty. */
+static struct frame *
+pop_free (void)
+{
+  struct frame *f = free_frames;
+
+  if (f != NULL)
+    {
+      free_frames = f->next_free;
+      f->next_free = NULL;
+      free_cnt--;
+    }
+  return f;
+}
+
+/* Pager thread.  Sleeps until the number of free frames drops
+   below pager_low, then evicts pages until pager_high frames are
+   free or nothing more can be evicted. */
+static void
+pager (void *aux UNUSED)
+{
+  lock_acquire (&frame_lock);
+  for (;;)
+    {
+      int64_t start;
+      size_t freed = 0;
+
+      while (free_cnt >= pager_low)
+        cond_wait (&pager_wake, &frame_lock);
+
+      pager_wakeups++;
+      start = timer_ticks ();
+      while (free_cnt < pager_high)
+        {
+          struct frame *f = evict (&freed);
+          if (f == NULL)
+            break;
+          push_free (f);
+        }
+      pager_freed += freed;
+      pager_ticks += timer_ticks () - start;
+
+      /* If nothing could be evicted, don't spin until the next
+         allocation. */
+      if (free_cnt < pager_low)
+        cond_wait (&pager_wake, &frame_lock);
+    }
+}
+
+/* Returns the kernel virtual address of frame F. */
+static void *
+frame_kpage (const struct frame *f)
+{
+  return user_pool_base + (f - frames) * PGSIZE;
+}
+
+/* Returns true if F holds a page that may be evicted. */
+static bool
+evictable (const struct frame *f)
+{
+  return f->page != NULL && !f->locked && f->pin_cnt == 0;
+}
+
+/* Returns true if any page in F has been accessed since the last
+   call, and clears their accessed bits. */
+static bool
+test_and_clear_accessed (struct frame *f)
+{
+  struct page *p;
+  bool accessed = false;
+
+  for (p = f->page; p != NULL; p = p->next_sharer)
+    if (page_test_and_clear_accessed (p))
+      accessed = true;
+  return accessed;
+}
+
+/* Clock hand shared by the clock and WSClock policies. */
+static size_t clock_hand;
+
+/* Returns the frame under the clock hand and advances the
+   hand. */
+static struct frame *
+clock_advance (void)
+{
+  struct frame *f = &frames[clock_hand];
+  clock_hand = (clock_hand + 1) % frame_cnt;
+  return f;
+}
+
+/* Clock (second chance) policy.  Sweeps the frames in a circle,
+   clearing accessed bits, and picks the first page that has not
+   been accessed since the hand last passed it. */
+static struct frame *
+clock_victim (void)
+{
+  size_t i;
+
+  for (i = 0; i < 2 * frame_cnt; i++)
+    {
+      struct frame *f = clock_advance ();
+      if (evictable (f) && !test_and_clear_accessed (f))
+        return f;
     }
-  }
   return NULL;
 }
 
+/* Aging policy.  Every AGING_PERIOD timer ticks, the aging
+   thread shifts each frame's age counter right and its page's
+   accessed bit into the top.  The page with the smallest counter,
+   that is, the one least used in the recent past, is evicted. */
+#define AGING_PERIOD 4
+
+static struct frame *
+aging_victim (void)
+{
+  struct frame *victim = NULL;
+  size_t i;
+
+  for (i = 0; i < frame_cnt; i++)
+    {
+      struct frame *f = clock_advance ();
+      if (evictable (f) && (victim == NULL || f->age < victim->age))
+        victim = f;
+    }
+  return victim;
+}
+
+/* Shifts each frame's accessed bit into its age counter.  Run
+   by the aging thread, with frame_lock held. */
+static void
+aging_sweep (void)
+{
+  size_t i;
+
+  for (i = 0; i < frame_cnt; i++)
+    {
+      struct frame *f = &frames[i];
+      if (evictable (f))
+        f->age = (f->age >> 1) | (test_and_clear_accessed (f) ? 0x80 : 0);
+    }
+}
+
+/* Aging thread.  Sweeps the frames every AGING_PERIOD ticks.
+   Sweeping here rather than in the timer interrupt keeps the
+   interrupt short however many frames there are. */
+static void
+ager (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (AGING_PERIOD);
+      lock_acquire (&frame_lock);
+      policy->age ();
+      lock_release (&frame_lock);
+    }
+}
+
+/* WSClock policy.  Like clock, but a page that has not been
+   accessed is kept anyway while it is still in its process's
+   working set, i.e. if it was accessed within the last
+   WSCLOCK_TAU ticks.  Among pages outside the working set, clean
+   ones are preferred, since evicting them costs no write.  If
+   every page is in a working set, falls back to plain clock. */
+#define WSCLOCK_TAU (TIMER_FREQ / 2)
+
+static struct frame *
+wsclock_victim (void)
+{
+  uint32_t now = timer_ticks ();
+  struct frame *dirty_victim = NULL;
+  size_t i;
+
+  for (i = 0; i < frame_cnt; i++)
+    {
+      struct frame *f = clock_advance ();
+
+      if (!evictable (f))
+        continue;
+      if (test_and_clear_accessed (f))
+        f->last_used = now;
+      else if (now - f->last_used > WSCLOCK_TAU)
+        {
+          if (!page_is_dirty (f->page))
+            return f;
+          if (dirty_victim == NULL)
+            dirty_victim = f;
+        }
+    }
+  return dirty_victim != NULL ? dirty_victim : clock_victim ();
+}
+
+/* Same-page merging.
+
+   The merging thread wakes up MERGE_FREQ times a second and
+   scans the next merge_rate / MERGE_FREQ frames of the frame
+   table; see the comment at the top of this file. */
+#define MERGE_FREQ 10
 
-//TODO: following function is not complete. The LRU algorithm to find the frame to be evicted is implemented; not yet implement how to actually evict the frame(just remove from list and call palloc?). Feel free to rewrite or change the function accordingly
+static void merge_frame (struct frame *);
 
-static void evict_frame(void){
-  //set current frame LRU bit to 0 
-  if (cur_frame_ptr == NULL) cur_frame_ptr = &list_begin(&frame_list);
-  cur_frame_ptr->LRU_bit = 0;
+/* Returns true if F holds pages that the merging thread may
+   merge with identical ones: they must be ordinary writable
+   memory, and F must be neither shared text nor already known to
+   the merging thread. */
+static bool
+mergeable (const struct frame *f)
+{
+  struct page *p;
 
-  lock_acquire(frame_lock);
-  //start with next frame and circulate the frame list
-  for (e = list_next(*cur_frame_ptr); e != list_end(&frame_list); e = list_next(e)) {
-    struct frame *fp = list_entry(e, struct frame, list_elem);
-    if (fp->LRU_bit == 0){
-      fp->LRU_bit = 1;
-    } else {
-      //TODO: evict this frame
+  if (!evictable (f) || f->table != NULL)
+    return false;
+  for (p = f->page; p != NULL; p = p->next_sharer)
+    if (!page_mergeable (p))
+      return false;
+  return true;
+}
 
+/* Called by hash_clear() for each merge candidate of the sweep
+   that just ended. */
+static void
+forget_unstable (struct hash_elem *e, void *aux UNUSED)
+{
+  hash_entry (e, struct frame, share_elem)->table = NULL;
+}
 
+/* Merging thread.  Sweeps the frame table at merge_rate frames
+   per second.  Candidates are only compared within one sweep,
+   since their contents may change at any time. */
+static void
+merger (void *aux UNUSED)
+{
+  int64_t interval = TIMER_FREQ / MERGE_FREQ;
+  size_t batch = merge_rate / MERGE_FREQ;
 
-      lock_release(frame_lock);
-      return;
+  if (batch == 0)
+    {
+      batch = 1;
+      interval = TIMER_FREQ / merge_rate > 0 ? TIMER_FREQ / merge_rate : 1;
     }
-  }
 
-  //wrap the list back to beginning(full circular check)
-  for (e = list_begin(&frame_list); e != *cur_frame_ptr; e = list_next(e)){
-    struct frame *fp = list_entry(e, struct frame, list_elem);
-    if (fp->LRU_bit == 0){
-      fp->LRU = 1;
-    } else {
-      //TODO: evict this frame
+  for (;;)
+    {
+      size_t i;
 
+      timer_sleep (interval);
+      lock_acquire (&frame_lock);
+      for (i = 0; i < batch; i++)
+        {
+          struct frame *f = &frames[merge_hand];
 
-      lock_release(frame_lock);
-      return;
+          if (++merge_hand == frame_cnt)
+            {
+              merge_hand = 0;
+              hash_clear (&unstable_frames, forget_unstable);
+            }
+          merge_scan_cnt++;
+          if (mergeable (f))
+            merge_frame (f);
+        }
+      lock_release (&frame_lock);
     }
-  }
 }
 
+/* Checksums frame F, which must be mergeable(), and if it has not
+   changed since the last sweep, looks for a frame with the same
+   contents.  If there is one, moves F's pages to that frame,
+   read-only, and frees F.  Otherwise, F becomes a candidate for
+   the rest of this sweep.  Must be called with frame_lock held,
+   which is released while the frames are compared. */
+static void
+merge_frame (struct frame *f)
+{
+  void *kpage = frame_kpage (f);
+  struct frame *twin;
+  struct hash_elem *e;
+  struct page *p;
+  uint32_t checksum;
+  bool same;
+
+  f->locked = true;
+  lock_release (&frame_lock);
+  checksum = hash_bytes (kpage, PGSIZE);
+  lock_acquire (&frame_lock);
+
+  if (checksum != f->checksum)
+    {
+      /* Modified since the last sweep, so likely to be modified
+         again soon. */
+      f->checksum = checksum;
+      goto done;
+    }
+
+  e = hash_find (&merged_frames, &f->share_elem);
+  if (e == NULL)
+    {
+      e = hash_insert (&unstable_frames, &f->share_elem);
+      if (e == NULL)
+        {
+          f->table = &unstable_frames;
+          goto done;
+        }
+    }
+  twin = hash_entry (e, struct frame, share_elem);
+  if (twin->page == NULL || twin->locked || twin->pin_cnt > 0
+      || twin->ref_cnt + f->ref_cnt > UINT16_MAX)
+    goto done;
+  twin->locked = true;
+  lock_release (&frame_lock);
+
+  /* With both frames locked and their pages read-only, neither
+     can change from here on. */
+  for (p = f->page; p != NULL; p = p->next_sharer)
+    page_write_protect (p);
+  if (twin->table == &unstable_frames)
+    for (p = twin->page; p != NULL; p = p->next_sharer)
+      page_write_protect (p);
+  same = !memcmp (kpage, frame_kpage (twin), PGSIZE);
+  if (same)
+    for (p = f->page; p != NULL; p = p->next_sharer)
+      page_remap (p, frame_kpage (twin));
+
+  lock_acquire (&frame_lock);
+  if (same)
+    {
+      while (f->page != NULL)
+        {
+          p = f->page;
+          f->page = p->next_sharer;
+          p->next_sharer = twin->page;
+          twin->page = p;
+          p->kpage = frame_kpage (twin);
+          twin->ref_cnt++;
+          merge_cnt++;
+        }
+      f->ref_cnt = 0;
+      if (twin->table == &unstable_frames)
+        {
+          unpublish (twin);
+          if (hash_insert (&merged_frames, &twin->share_elem) == NULL)
+            twin->table = &merged_frames;
+        }
+    }
+  else if (twin->table == &unstable_frames)
+    {
+      /* The twin changed after it was checksummed. */
+      unpublish (twin);
+    }
+  twin->locked = false;
+
+ done:
+  f->locked = false;
+  if (f->page == NULL)
+    push_free (f);
+  cond_broadcast (&frame_unlocked, &frame_lock);
+}
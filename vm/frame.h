@@ -1,18 +1,70 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
 
+#include <hash.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "filesys/off_t.h"
+#include "threads/palloc.h"
 
-struct frame{
-  void* page_addr; //base physical address
-  struct list_elem elem;
-  bool LRU_bit;
-  bool valid;
-  struct list pages; //points to all pages to share this frame
-  struct lock pages_lock;
-};
+struct inode;
+struct page;
 
-void frame_init(void);
+/* A frame of user memory.
 
-void* get_frame(void);
+   The frame table is an array of these, one for every page of
+   the user pool, indexed by the frame's page number within the
+   pool.  There can be thousands of frames, so keep it small.
 
-void free_frame(void* pa);
+   A frame holding a page of read-only executable text may be
+   shared by every process running the program, and fork() leaves
+   every resident page shared, copy-on-write, between parent and
+   child.  `page' then heads a list, linked through the pages'
+   `next_sharer' members, of every page mapped to the frame,
+   which is what eviction uses to unmap them all, and `ref_cnt'
+   counts them.  The merging thread also makes frames shared
+   when it finds that several hold identical pages. */
+struct frame
+  {
+    struct page *page;          /* Pages held in this frame, or null. */
+    struct frame *next_free;    /* Next frame on the free list. */
+    struct inode *inode;        /* Shared text: file's inode, or null. */
+    off_t inode_ofs;            /* Shared text: offset in file. */
+    struct hash_elem share_elem; /* Element in `table'. */
+    struct hash *table;         /* Shared or merge table, or null. */
+    uint32_t checksum;          /* Merging: contents at last scan. */
+    uint32_t last_used;         /* Tick of last observed access. */
+    uint16_t ref_cnt;           /* Number of pages in `page' list. */
+    uint8_t age;                /* Aging counter, MSB most recent. */
+    uint8_t pin_cnt;            /* Pinned by this many system calls. */
+    bool locked;                /* Being filled or evicted? */
+  };
 
-struct frame* find_frame(void* pa);
+void frame_init (void);
+bool frame_set_policy (const char *name);
+void frame_set_watermarks (size_t low, size_t high);
+void frame_start_pager (void);
+void frame_set_merge_rate (size_t pages_per_sec);
+void frame_start_merger (void);
+void frame_print_stats (void);
+
+void *get_frame (enum palloc_flags flags, struct page *);
+void *get_free_frame (struct page *);
+void frame_reclaim_begin (void);
+void frame_reclaim_end (void);
+void frame_unlock (void *kpage);
+void free_frame (void *kpage);
+void *frame_share (struct page *, struct inode *, off_t);
+void frame_publish (void *kpage, struct inode *, off_t);
+void *frame_lock_page (struct page *);
+void frame_release_page (void *kpage, struct page *);
+void frame_add_page (void *kpage, struct page *);
+void frame_remove_page (void *kpage, struct page *);
+bool frame_make_private (void *kpage);
+bool frame_wait (struct page *);
+bool frame_pin (struct page *);
+void frame_unpin (struct page *);
+struct frame *find_frame (const void *kpage);
+
+#endif /* vm/frame.h */
@@ -0,0 +1,134 @@
+#include "vm/mmap.h"
+#include <debug.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/syscall.h"
+#include "vm/page.h"
+
+/* Memory-mapped files.
+
+   A mapping covers whole pages from a page-aligned address.  Its
+   pages are entered in the supplemental page table as PAGE_MMAP
+   pages and read in by the page fault handler when first
+   touched.  Only pages the hardware has marked dirty are ever
+   written back to the file: on eviction, on munmap, and at
+   process exit.
+
+   Each mapping holds its own reopened file, so it keeps working
+   after the process closes or removes the file. */
+
+static void unmap (struct mapping *);
+
+/* Prepares the current process to create mappings. */
+void
+mmap_init (void)
+{
+  struct thread *t = thread_current ();
+
+  list_init (&t->mappings);
+  t->next_mapid = 0;
+}
+
+/* Maps FILE, which the mapping takes over, into the current
+   process's address space starting at ADDR.  Returns the new
+   mapping's identifier, or MAP_FAILED if the file is empty, if
+   ADDR is null or not page-aligned, or if the mapping would
+   overlap pages already in use or the kernel.  FILE is closed on
+   failure. */
+mapid_t
+mmap_create (struct file *file, void *addr)
+{
+  struct thread *t = thread_current ();
+  struct mapping *m;
+  off_t length;
+  size_t i;
+
+  lock_acquire (&lock_filesys);
+  length = file_length (file);
+  lock_release (&lock_filesys);
+
+  m = malloc (sizeof *m);
+  if (m == NULL || length == 0 || addr == NULL || pg_ofs (addr) != 0)
+    goto fail;
+  m->file = file;
+  m->base = addr;
+  m->page_cnt = 0;
+
+  /* Reject overlaps before adding anything. */
+  for (i = 0; i < (size_t) length; i += PGSIZE)
+    if (!is_user_vaddr (m->base + i)
+        || page_lookup (&t->pages, m->base + i) != NULL)
+      goto fail;
+
+  for (i = 0; i < (size_t) length; i += PGSIZE)
+    {
+      size_t read_bytes = length - i < PGSIZE ? length - i : PGSIZE;
+
+      if (!page_add_mmap (m->base + i, file, i, read_bytes))
+        {
+          unmap (m);
+          return MAP_FAILED;
+        }
+      m->page_cnt++;
+    }
+
+  m->id = t->next_mapid++;
+  list_push_back (&t->mappings, &m->elem);
+  return m->id;
+
+ fail:
+  free (m);
+  lock_acquire (&lock_filesys);
+  file_close (file);
+  lock_release (&lock_filesys);
+  return MAP_FAILED;
+}
+
+/* Unmaps the current process's mapping ID, if it exists. */
+void
+mmap_destroy (mapid_t id)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&t->mappings); e != list_end (&t->mappings);
+       e = list_next (e))
+    {
+      struct mapping *m = list_entry (e, struct mapping, elem);
+      if (m->id == id)
+        {
+          list_remove (&m->elem);
+          unmap (m);
+          return;
+        }
+    }
+}
+
+/* Unmaps all of the current process's mappings. */
+void
+mmap_destroy_all (void)
+{
+  struct thread *t = thread_current ();
+
+  while (!list_empty (&t->mappings))
+    unmap (list_entry (list_pop_front (&t->mappings),
+                       struct mapping, elem));
+}
+
+/* Removes M's pages, writing back those that were modified,
+   closes its file, and frees it. */
+static void
+unmap (struct mapping *m)
+{
+  size_t i;
+
+  for (i = 0; i < m->page_cnt; i++)
+    page_remove (m->base + i * PGSIZE);
+
+  lock_acquire (&lock_filesys);
+  file_close (m->file);
+  lock_release (&lock_filesys);
+  free (m);
+}
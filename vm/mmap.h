@@ -0,0 +1,27 @@
+#ifndef VM_MMAP_H
+#define VM_MMAP_H
+
+#include <list.h>
+
+struct file;
+
+/* Map region identifier. */
+typedef int mapid_t;
+#define MAP_FAILED ((mapid_t) -1)
+
+/* A memory-mapped file. */
+struct mapping
+  {
+    struct list_elem elem;      /* Element in thread's `mappings'. */
+    mapid_t id;                 /* Mapping identifier. */
+    struct file *file;          /* File mapped, reopened for us. */
+    uint8_t *base;              /* First mapped page. */
+    size_t page_cnt;            /* Number of pages mapped. */
+  };
+
+void mmap_init (void);
+mapid_t mmap_create (struct file *, void *addr);
+void mmap_destroy (mapid_t);
+void mmap_destroy_all (void);
+
+#endif /* vm/mmap.h */
@@ -0,0 +1,1260 @@
+#include "vm/page.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/file.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/syscall.h"
+#include "vm/frame.h"
+
+static unsigned page_hash (const struct hash_elem *, void *aux);
+static bool page_less (const struct hash_elem *, const struct hash_elem *,
+                       void *aux);
+static void page_free (struct hash_elem *, void *aux);
+static struct page *add_page (void *upage, enum page_type, struct file *,
+                              off_t ofs, uint32_t read_bytes, bool writable);
+static void release_page (struct page *);
+static bool page_load (struct page *, void *kpage);
+static void write_back (struct page *, const void *kpage);
+static bool lock_fs (void);
+static void unlock_fs (bool acquired);
+static void account_swap (struct page *, int delta);
+static void account_swap_out (struct page *);
+static void account_swap_in (struct page *);
+static bool shareable (const struct page *);
+static bool bring_in (struct page *, enum page_prefetch);
+static void read_ahead (struct page *, swap_slot_t);
+static void fault_around (struct page *);
+static bool page_precedes (const struct page *, const struct page *);
+static void settle_prefetch (struct page *, bool accessed);
+static bool maps_zero_page (const struct page *);
+static bool copy_shared_frame (struct page *);
+static void discard_page (struct page *);
+static void willneed_queue (struct page *);
+static void willneed_cancel (struct page *);
+static void prefetch (struct page *);
+static thread_func prefetcher NO_RETURN;
+
+/* Most pages read from swap on one fault, including the page
+   faulted on. */
+#define READ_AHEAD_PAGES SWAP_CLUSTER
+
+/* Bytes the user stack may grow to, counting down from
+   PHYS_BASE.  Set with -stack. */
+static size_t stack_limit = 8 * 1024 * 1024;
+
+/* Farthest below the stack pointer that an instruction may
+   touch: PUSHA stores 32 bytes below %esp before it updates
+   %esp. */
+#define STACK_SLOP 32
+
+/* Pages mapped around a faulting page, for new processes.  Set
+   with -faultaround. */
+static size_t fault_around_default = 4;
+
+/* Pages mapped after a faulting page in a range advised
+   MADV_SEQUENTIAL. */
+#define SEQUENTIAL_PAGES 16
+
+/* Number of pages dropped with MADV_DONTNEED. */
+static long long dontneed_cnt;
+
+/* Prefetcher thread.
+
+   MADV_WILLNEED queues the pages of its range here and returns
+   at once, and the prefetcher brings them in while the process
+   keeps running.  A page's owner leaves it alone while it is
+   queued or being brought in: every path by which the owner may
+   touch a page that is not resident first calls
+   willneed_cancel(), which takes the page off the queue or waits
+   for the prefetcher to finish with it. */
+static struct list willneed_pages;      /* Pages to bring in. */
+static struct lock willneed_lock;       /* Protects the above. */
+static struct condition willneed_ready; /* Signaled when a page is queued. */
+static struct condition willneed_done;  /* Signaled when a page is done. */
+static struct page *willneed_busy;      /* Page being brought in, or null. */
+static bool prefetcher_running;         /* Has prefetcher started? */
+
+/* A page of zeros, mapped read-only in place of every all-zero
+   page that has only been read.  It is not a frame, so it is
+   never evicted. */
+static void *zero_page;
+
+/* Statistics on the zero page. */
+static long long zero_map_cnt;  /* # of pages mapped to it. */
+static long long zero_cow_cnt;  /* # of those later written. */
+
+/* Statistics on frames shared by fork(). */
+static long long fork_share_cnt; /* # of pages shared with a child. */
+static long long fork_copy_cnt;  /* # copied on a later write. */
+static long long fork_reuse_cnt; /* # written after the others left. */
+
+/* Statistics on pinning. */
+static long long pin_cnt;       /* # of pages pinned. */
+static int64_t pin_ticks;       /* Ticks spent bringing them in. */
+
+/* Statistics on pages brought in early, by reason. */
+static long long prefetch_cnt[PREFETCH_CNT];    /* # brought in. */
+static long long prefetch_hits[PREFETCH_CNT];   /* # accessed later. */
+static long long prefetch_misses[PREFETCH_CNT]; /* # never accessed. */
+
+/* Initializes the supplemental page table module. */
+void
+page_init (void)
+{
+  zero_page = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+  list_init (&willneed_pages);
+  lock_init (&willneed_lock);
+  cond_init (&willneed_ready);
+  cond_init (&willneed_done);
+}
+
+/* Starts the prefetcher thread.  Call after the swap device has
+   been set up, since the prefetcher may read pages from swap.
+   Until then, MADV_WILLNEED is ignored. */
+void
+page_start_prefetcher (void)
+{
+  prefetcher_running = true;
+  thread_create ("prefetcher", PRI_DEFAULT, prefetcher, NULL);
+}
+
+/* Initializes T's supplemental page table as empty.
+   Returns false if memory allocation fails. */
+bool
+page_table_init (struct thread *t)
+{
+  t->fault_around = fault_around_default;
+  t->acct = calloc (1, sizeof *t->acct);
+  if (t->acct == NULL)
+    return false;
+  if (!hash_init (&t->pages, page_hash, page_less, NULL))
+    {
+      free (t->acct);
+      t->acct = NULL;
+      return false;
+    }
+  return true;
+}
+
+/* Frees every page in PAGES, along with the frames of those that
+   are resident, which are also unmapped from their page
+   directory.  Modified pages of mapped files are written back.
+   Then frees ACCT, the accounting of the process that owned
+   them.  Need not run in that process. */
+void
+page_table_destroy (struct hash *pages, struct page_acct *acct)
+{
+  struct hash_iterator i;
+
+  hash_first (&i, pages);
+  while (hash_next (&i))
+    release_page (hash_entry (hash_cur (&i), struct page, hash_elem));
+  hash_destroy (pages, page_free);
+  free (acct);
+}
+
+/* Records in the current process's supplemental page table that
+   user page UPAGE is to be filled with READ_BYTES bytes read
+   from FILE at offset OFS, followed by zeros.  A READ_BYTES of 0
+   makes UPAGE an all-zero page and FILE is not used.  Nothing is
+   read until the page is first touched.
+   Returns false if UPAGE is already in the table or if memory
+   allocation fails. */
+bool
+page_add_file (void *upage, struct file *file, off_t ofs,
+               uint32_t read_bytes, bool writable)
+{
+  return add_page (upage, read_bytes > 0 ? PAGE_FILE : PAGE_ZERO,
+                   file, ofs, read_bytes, writable) != NULL;
+}
+
+/* Like page_add_file(), but makes UPAGE a writable page of a
+   mapping of FILE: when it is evicted or unmapped, and only if it
+   was modified, its first READ_BYTES bytes are written back to
+   FILE at OFS. */
+bool
+page_add_mmap (void *upage, struct file *file, off_t ofs,
+               uint32_t read_bytes)
+{
+  return add_page (upage, PAGE_MMAP, file, ofs, read_bytes, true) != NULL;
+}
+
+/* Removes UPAGE from the current process's address space,
+   writing it back first if it is a modified page of a mapped
+   file. */
+void
+page_remove (void *upage)
+{
+  struct thread *t = thread_current ();
+  struct page *p = page_lookup (&t->pages, upage);
+
+  if (p != NULL)
+    {
+      release_page (p);
+      hash_delete (&t->pages, &p->hash_elem);
+      page_free (&p->hash_elem, NULL);
+    }
+}
+
+/* Adds a page of type TYPE to the current process's supplemental
+   page table and returns it.  See page_add_file(). */
+static struct page *
+add_page (void *upage, enum page_type type, struct file *file, off_t ofs,
+          uint32_t read_bytes, bool writable)
+{
+  struct thread *t = thread_current ();
+  struct page *p;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (read_bytes <= PGSIZE);
+
+  p = malloc (sizeof *p);
+  if (p == NULL)
+    return NULL;
+
+  p->upage = upage;
+  p->owner = t->acct;
+  p->pagedir = t->pagedir;
+  p->kpage = NULL;
+  p->next_sharer = NULL;
+  p->evicted = false;
+  p->swap_slot = SWAP_NONE;
+  p->prefetched = PREFETCH_NONE;
+  p->zero_mapped = false;
+  p->advice = MADV_NORMAL;
+  p->willneed = false;
+  p->writable = writable;
+  p->type = type;
+  p->file = file;
+  p->file_ofs = ofs;
+  p->read_bytes = read_bytes;
+
+  if (hash_insert (&t->pages, &p->hash_elem) != NULL)
+    {
+      free (p);
+      return NULL;
+    }
+  return p;
+}
+
+/* Copies the supplemental page table of PARENT, which must stay
+   blocked until this returns, into the current process, whose
+   table must be empty.  Pages that PARENT has in frames are
+   shared with it, mapped read-only in both processes until one
+   of them writes, and pages in swap share PARENT's slots; the
+   rest are brought in on first touch as usual.  Pages of mapped
+   files are not copied.  FILE, the current process's own handle
+   on its executable, takes the place of PARENT's in pages read
+   from it.  Returns false if memory allocation fails. */
+bool
+page_table_copy (struct thread *parent, struct file *file)
+{
+  struct thread *t = thread_current ();
+  struct hash_iterator i;
+
+  hash_first (&i, &parent->pages);
+  while (hash_next (&i))
+    {
+      struct page *p = hash_entry (hash_cur (&i), struct page, hash_elem);
+      struct page *q;
+      void *kpage;
+
+      if (p->type == PAGE_MMAP)
+        continue;
+      willneed_cancel (p);
+      q = add_page (p->upage, p->type, p->type == PAGE_FILE ? file : NULL,
+                    p->file_ofs, p->read_bytes, p->writable);
+      if (q == NULL)
+        return false;
+      q->advice = p->advice;
+
+      kpage = frame_lock_page (p);
+      if (kpage != NULL)
+        {
+          if (!pagedir_set_page (t->pagedir, q->upage, kpage, false))
+            {
+              frame_unlock (kpage);
+              return false;
+            }
+          frame_add_page (kpage, q);
+          pagedir_set_dirty (t->pagedir, q->upage, page_is_dirty (p));
+          if (p->writable)
+            pagedir_set_writable (p->pagedir, p->upage, false);
+          fork_share_cnt++;
+          frame_unlock (kpage);
+        }
+      else if (p->swap_slot != SWAP_NONE)
+        {
+          swap_dup (p->swap_slot);
+          q->swap_slot = p->swap_slot;
+          account_swap (q, 1);
+        }
+    }
+  t->fault_around = parent->fault_around;
+  return true;
+}
+
+/* Returns the page in PAGES that contains UPAGE, or a null
+   pointer if there is none. */
+struct page *
+page_lookup (struct hash *pages, const void *upage)
+{
+  struct page p;
+  struct hash_elem *e;
+
+  p.upage = pg_round_down (upage);
+  e = hash_find (pages, &p.hash_elem);
+  return e != NULL ? hash_entry (e, struct page, hash_elem) : NULL;
+}
+
+/* Brings user page UPAGE of the current process into a frame and
+   maps it.  WRITE says whether the access that needs UPAGE is a
+   write: a page of zeros that is only being read is mapped to
+   the zero page instead of a frame of its own.  Returns true if
+   successful, false if UPAGE is not part of the process's
+   address space or if no frame could be obtained. */
+bool
+page_in (void *upage, bool write)
+{
+  struct thread *t = thread_current ();
+  struct page *p;
+  swap_slot_t slot;
+
+  p = page_lookup (&t->pages, upage);
+  if (p == NULL)
+    return false;
+  willneed_cancel (p);
+
+  /* The page may have been on its way out when we faulted on it,
+     in which case eviction may also have failed and left it in
+     place.  Wait for it before looking at its swap slot, which
+     page_out() sets only once the page is written. */
+  if (frame_wait (p))
+    {
+      t->acct->minor_faults++;
+      return true;
+    }
+
+  if (!write && maps_zero_page (p))
+    {
+      if (!pagedir_set_page (t->pagedir, p->upage, zero_page, false))
+        return false;
+      p->zero_mapped = true;
+      zero_map_cnt++;
+      t->acct->minor_faults++;
+      return true;
+    }
+
+  slot = p->swap_slot;
+  if (!bring_in (p, PREFETCH_NONE))
+    return false;
+
+  if (p->advice == MADV_RANDOM)
+    return true;
+  if (slot != SWAP_NONE)
+    read_ahead (p, slot);
+  else
+    fault_around (p);
+  return true;
+}
+
+/* Gives user page UPAGE of the current process, which is mapped
+   read-only and has just faulted on a write, a frame of its own,
+   mapped writable.  The page is either mapped to the zero page,
+   and gets a zeroed frame, or shares its frame with other
+   processes since fork(), and gets a copy of it, unless the
+   others have let go of it in the meantime.  Returns true if
+   successful, false if UPAGE is not such a page, in which case
+   the write is a real protection violation, or if no frame could
+   be obtained. */
+bool
+page_copy_on_write (void *upage)
+{
+  struct thread *t = thread_current ();
+  struct page *p;
+  void *kpage;
+
+  p = page_lookup (&t->pages, upage);
+  if (p == NULL || !p->writable)
+    return false;
+  willneed_cancel (p);
+  if (!p->zero_mapped)
+    return copy_shared_frame (p);
+
+  kpage = get_frame (PAL_USER, p);
+  if (kpage == NULL)
+    return false;
+  memset (kpage, 0, PGSIZE);
+
+  pagedir_clear_page (t->pagedir, p->upage);
+  p->zero_mapped = false;
+  if (!pagedir_set_page (t->pagedir, p->upage, kpage, true))
+    {
+      free_frame (kpage);
+      return false;
+    }
+  p->kpage = kpage;
+  zero_cow_cnt++;
+  t->acct->minor_faults++;
+  frame_unlock (kpage);
+  return true;
+}
+
+/* Gives page P of the current process, which is writable but
+   mapped read-only because fork() left its frame shared, a frame
+   of its own.  See page_copy_on_write(). */
+static bool
+copy_shared_frame (struct page *p)
+{
+  struct thread *t = thread_current ();
+  void *kpage, *copy;
+
+  /* If P was evicted after the fault, just let the write fault
+     again, on a page that is not present. */
+  kpage = frame_lock_page (p);
+  if (kpage == NULL)
+    return true;
+
+  if (frame_make_private (kpage))
+    {
+      /* Every other process sharing the frame is done with it, or
+         it was only write-protected for merging. */
+      pagedir_set_writable (t->pagedir, p->upage, true);
+      fork_reuse_cnt++;
+      t->acct->minor_faults++;
+      frame_unlock (kpage);
+      return true;
+    }
+
+  frame_remove_page (kpage, p);
+  copy = get_frame (PAL_USER, p);
+  if (copy == NULL)
+    {
+      frame_add_page (kpage, p);
+      frame_unlock (kpage);
+      return false;
+    }
+  memcpy (copy, kpage, PGSIZE);
+  frame_unlock (kpage);
+
+  /* The shared frame may have been modified before the fork, so
+     the copy must be written to swap if it is evicted. */
+  pagedir_clear_page (t->pagedir, p->upage);
+  if (!pagedir_set_page (t->pagedir, p->upage, copy, true))
+    {
+      free_frame (copy);
+      return false;
+    }
+  pagedir_set_dirty (t->pagedir, p->upage, true);
+  p->kpage = copy;
+  fork_copy_cnt++;
+  t->acct->minor_faults++;
+  frame_unlock (copy);
+  return true;
+}
+
+/* Returns true if P may be mapped to the zero page: it must not
+   be resident, and must be all zeros and never have been
+   written, or else it would have a swap slot.  The caller must
+   have waited out any eviction of P with frame_wait(), since a
+   page being evicted gets its swap slot only once it has been
+   written. */
+static bool
+maps_zero_page (const struct page *p)
+{
+  return (p->kpage == NULL && p->type == PAGE_ZERO
+          && p->swap_slot == SWAP_NONE);
+}
+
+/* Brings page P of the current process, which is not resident,
+   into a frame and maps it.  If WHY is not PREFETCH_NONE, P is
+   being brought in before it is needed: then only a frame that is
+   already free is used, and P is mapped not accessed, so that the
+   replacement policy reclaims it first if the guess was wrong.
+   Need not run in P's process, so that the prefetcher can use it.
+   Returns true if successful, false if no frame could be had or
+   on an I/O error. */
+static bool
+bring_in (struct page *p, enum page_prefetch why)
+{
+  swap_slot_t slot = p->swap_slot;
+  void *kpage = NULL;
+
+  /* Another process running the same program may already have
+     this page of its text in a frame. */
+  if (shareable (p))
+    kpage = frame_share (p, file_get_inode (p->file), p->file_ofs);
+  if (kpage != NULL)
+    {
+      if (!pagedir_set_page (p->pagedir, p->upage, kpage, p->writable))
+        {
+          frame_release_page (kpage, p);
+          return false;
+        }
+      if (why == PREFETCH_NONE)
+        p->owner->minor_faults++;
+    }
+  else
+    {
+      kpage = why == PREFETCH_NONE ? get_frame (PAL_USER, p)
+                                   : get_free_frame (p);
+      if (kpage == NULL)
+        return false;
+      if (!page_load (p, kpage)
+          || !pagedir_set_page (p->pagedir, p->upage, kpage, p->writable))
+        {
+          free_frame (kpage);
+          return false;
+        }
+
+      if (slot != SWAP_NONE)
+        {
+          /* A page read back from swap no longer has a copy
+             anywhere else, so it must be written out again if it
+             is evicted. */
+          swap_free (slot);
+          p->swap_slot = SWAP_NONE;
+          account_swap (p, -1);
+          account_swap_in (p);
+          pagedir_set_dirty (p->pagedir, p->upage, true);
+        }
+      else if (shareable (p))
+        frame_publish (kpage, file_get_inode (p->file), p->file_ofs);
+      p->kpage = kpage;
+
+      if (why == PREFETCH_NONE)
+        {
+          if (slot != SWAP_NONE || p->type != PAGE_ZERO)
+            p->owner->major_faults++;
+          else
+            p->owner->minor_faults++;
+        }
+    }
+
+  if (why != PREFETCH_NONE)
+    {
+      pagedir_set_accessed (p->pagedir, p->upage, false);
+      p->prefetched = why;
+      prefetch_cnt[why]++;
+    }
+  frame_unlock (kpage);
+  return true;
+}
+
+/* Grows the current process's stack to cover FAULT_ADDR, a user
+   address that is not part of the address space, if the access
+   looks like a push onto the stack, given user stack pointer
+   ESP, and stays within the stack limit.  Returns true if
+   successful, false if FAULT_ADDR is a bad access or if memory
+   is exhausted. */
+bool
+page_grow_stack (const void *fault_addr, const void *esp)
+{
+  void *upage = pg_round_down (fault_addr);
+
+  if ((const uint8_t *) fault_addr + STACK_SLOP < (const uint8_t *) esp
+      || (size_t) ((uint8_t *) PHYS_BASE - (uint8_t *) upage) > stack_limit)
+    return false;
+
+  return page_add_file (upage, NULL, 0, 0, true) && page_in (upage, true);
+}
+
+/* Sets the stack limit of processes to BYTES. */
+void
+page_set_stack_limit (size_t bytes)
+{
+  stack_limit = bytes;
+}
+
+/* Makes sure that the user page containing UADDR, in the current
+   process, is in memory, bringing it in or growing the stack to
+   cover it as a page fault would, and pins it there until
+   page_unpin(), so that the kernel can access it without
+   faulting, e.g. while holding the file system lock.  If WRITE
+   is true, the page is also given a writable frame of its own.
+   Returns false if UADDR is not a valid user address for the
+   access or if memory is exhausted. */
+bool
+page_pin (const void *uaddr, bool write)
+{
+  struct thread *t = thread_current ();
+  void *upage = pg_round_down (uaddr);
+  int64_t start = timer_ticks ();
+  struct page *p;
+
+  if (!is_user_vaddr (uaddr))
+    return false;
+  p = page_lookup (&t->pages, upage);
+  if (p == NULL)
+    {
+      if (!page_grow_stack (uaddr, t->user_esp))
+        return false;
+      p = page_lookup (&t->pages, upage);
+    }
+  if (write && !p->writable)
+    return false;
+
+  /* The page may be evicted again between bringing it in and
+     pinning it, in which case try again.  A page mapped to the
+     zero page needs no pinning, since that is never evicted. */
+  for (;;)
+    {
+      if (p->kpage == NULL && !p->zero_mapped && !page_in (upage, write))
+        return false;
+      if (write && !pagedir_is_writable (t->pagedir, upage)
+          && !page_copy_on_write (upage))
+        return false;
+      if (p->zero_mapped || frame_pin (p))
+        break;
+    }
+
+  pin_cnt++;
+  pin_ticks += timer_ticks () - start;
+  return true;
+}
+
+/* Unpins the user page containing UADDR, in the current process,
+   which must have been pinned by page_pin(). */
+void
+page_unpin (const void *uaddr)
+{
+  struct page *p = page_lookup (&thread_current ()->pages, uaddr);
+
+  ASSERT (p != NULL);
+  if (!p->zero_mapped)
+    frame_unpin (p);
+}
+
+/* Reads in the pages that follow P, just read from swap SLOT, in
+   the current process's address space, as long as they are in
+   the slots that follow SLOT and frames are free.  page_out()
+   tends to put a process's consecutive pages in consecutive
+   slots, so this turns a sequential scan over swapped-out memory
+   into one fault and one run of disk reads per cluster.  If P
+   was advised MADV_SEQUENTIAL, reads the SEQUENTIAL_PAGES pages
+   after P instead, wherever they are in swap, skipping those
+   that are not in swap. */
+static void
+read_ahead (struct page *p, swap_slot_t slot)
+{
+  struct thread *t = thread_current ();
+  bool sequential = p->advice == MADV_SEQUENTIAL;
+  size_t n = sequential ? SEQUENTIAL_PAGES : READ_AHEAD_PAGES - 1;
+  size_t i;
+
+  for (i = 1; i <= n; i++)
+    {
+      uint8_t *upage = (uint8_t *) p->upage + i * PGSIZE;
+      struct page *q = page_lookup (&t->pages, upage);
+
+      if (q == NULL)
+        break;
+      willneed_cancel (q);
+      if (frame_wait (q) || q->swap_slot == SWAP_NONE)
+        {
+          if (sequential)
+            continue;
+          break;
+        }
+      if ((!sequential && q->swap_slot != slot + i)
+          || !bring_in (q, PREFETCH_READ_AHEAD))
+        break;
+    }
+}
+
+/* Maps the pages around P, just brought in from its file, in the
+   current process's address space, up to the process's
+   fault-around limit, if they come from the next or previous
+   pages of the same file.  Those are either already in memory,
+   as text shared with another process, or sit next to P on disk,
+   so each one costs much less now than a page fault later.  If P
+   was advised MADV_SEQUENTIAL, maps SEQUENTIAL_PAGES pages after
+   P instead, and if P is anonymous memory, those pages come from
+   swap or are zeroed, whichever they need. */
+static void
+fault_around (struct page *p)
+{
+  struct thread *t = thread_current ();
+  size_t n = t->fault_around;
+  uint8_t *start = (uint8_t *) p->upage - n / 2 * PGSIZE;
+  size_t i;
+
+  if (p->advice == MADV_SEQUENTIAL)
+    {
+      n = SEQUENTIAL_PAGES;
+      start = p->upage;
+    }
+  else if (p->type == PAGE_ZERO)
+    return;
+
+  for (i = 0; i <= n; i++)
+    {
+      uint8_t *upage = start + i * PGSIZE;
+      struct page *q;
+
+      if (upage == p->upage || !is_user_vaddr (upage))
+        continue;
+      q = page_lookup (&t->pages, upage);
+      if (q == NULL || q->type != p->type)
+        continue;
+      willneed_cancel (q);
+      if (q->zero_mapped || frame_wait (q))
+        continue;
+      if (p->type != PAGE_ZERO
+          && (q->swap_slot != SWAP_NONE
+              || file_get_inode (q->file) != file_get_inode (p->file)
+              || (q->file_ofs - p->file_ofs
+                  != upage - (uint8_t *) p->upage)))
+        continue;
+      bring_in (q, PREFETCH_FAULT_AROUND);
+    }
+}
+
+/* Sets the fault-around limit given to new processes to N. */
+void
+page_set_fault_around (size_t n)
+{
+  fault_around_default = n;
+}
+
+/* Applies ADVICE to the LEN bytes of the current process's
+   address space starting at ADDR, which must be page-aligned, as
+   for madvise():
+
+     - MADV_NORMAL, MADV_RANDOM and MADV_SEQUENTIAL set how many
+       neighbouring pages are brought in on a fault in the range.
+
+     - MADV_WILLNEED queues the range's pages for the prefetcher
+       thread, which brings them in, as far as there are free
+       frames, mapped not accessed like pages brought in by
+       fault-around.  The caller does not wait for them.
+
+     - MADV_DONTNEED drops the range's pages now.  Modified pages
+       of mapped files are written back first; other modified
+       pages are discarded, so that they read back from their
+       file, or as zeros, on the next access.
+
+   Pages in the range that are not part of the address space are
+   skipped.  Returns false if the range is not page-aligned user
+   memory or ADVICE is unknown. */
+bool
+page_advise (void *addr, size_t len, enum page_advice advice)
+{
+  struct thread *t = thread_current ();
+  uint8_t *upage = addr;
+  uint8_t *end = upage + (len + PGSIZE - 1) / PGSIZE * PGSIZE;
+
+  if (pg_ofs (addr) != 0 || end < upage || !is_user_vaddr (end - 1)
+      || advice > MADV_DONTNEED)
+    return false;
+
+  for (; upage < end; upage += PGSIZE)
+    {
+      struct page *p = page_lookup (&t->pages, upage);
+      if (p == NULL)
+        continue;
+
+      switch (advice)
+        {
+        case MADV_NORMAL:
+        case MADV_RANDOM:
+        case MADV_SEQUENTIAL:
+          p->advice = advice;
+          break;
+
+        case MADV_WILLNEED:
+          willneed_queue (p);
+          break;
+
+        case MADV_DONTNEED:
+          discard_page (p);
+          break;
+        }
+    }
+  return true;
+}
+
+/* Drops page P from memory and from swap, so that it is next
+   brought in from its original source.  Modified pages of mapped
+   files are written back first. */
+static void
+discard_page (struct page *p)
+{
+  release_page (p);
+  if (p->swap_slot != SWAP_NONE)
+    {
+      swap_free (p->swap_slot);
+      p->swap_slot = SWAP_NONE;
+      account_swap (p, -1);
+    }
+  dontneed_cnt++;
+}
+
+/* Evicts the CNT pages in PAGES, at most SWAP_CLUSTER, from
+   their frames, which the caller must have locked.  Unmaps each
+   page, along with any other pages sharing its frame, so that
+   their owners fault on their next access.  Pages that
+   have been modified are written to swap, in a single run of
+   consecutive slots if one is free.  Sets EVICTED[i] to true if
+   PAGES[i] was evicted, or to false if it had to be left mapped
+   in its frame for lack of swap space.
+   Returns the number of pages written to swap. */
+size_t
+page_out (struct page *pages[], size_t cnt, bool evicted[])
+{
+  size_t dirty[SWAP_CLUSTER];
+  size_t dirty_cnt = 0;
+  size_t written = 0;
+  swap_slot_t slot;
+  size_t i;
+
+  ASSERT (cnt <= SWAP_CLUSTER);
+
+  /* Unmap first, so that the owner can't modify the page once we
+     have looked at its dirty bit.  Keep the dirty pages sorted by
+     owner and address, so that each process's consecutive pages
+     land in consecutive slots, for read_ahead(). */
+  for (i = 0; i < cnt; i++)
+    {
+      struct page *p = pages[i];
+      struct page *q;
+
+      for (q = p; q != NULL; q = q->next_sharer)
+        pagedir_clear_page (q->pagedir, q->upage);
+      evicted[i] = true;
+      if (p->prefetched)
+        settle_prefetch (p, pagedir_is_accessed (p->pagedir, p->upage));
+      if (!page_is_dirty (p))
+        continue;
+
+      if (p->type == PAGE_MMAP)
+        {
+          /* A mapped file is its own backing store. */
+          write_back (p, p->kpage);
+          pagedir_set_dirty (p->pagedir, p->upage, false);
+          written++;
+        }
+      else
+        {
+          size_t j = dirty_cnt++;
+          for (; j > 0 && page_precedes (p, pages[dirty[j - 1]]); j--)
+            dirty[j] = dirty[j - 1];
+          dirty[j] = i;
+        }
+    }
+  if (dirty_cnt == 0)
+    return written;
+
+  /* Write the modified pages to one run of slots if possible,
+     otherwise to whatever slots are free.  Every page sharing a
+     frame refers to its slot. */
+  slot = swap_alloc (dirty_cnt);
+  for (i = 0; i < dirty_cnt; i++)
+    {
+      struct page *p = pages[dirty[i]];
+      swap_slot_t s = slot != SWAP_NONE ? slot + i : swap_alloc (1);
+
+      struct page *q;
+
+      if (s == SWAP_NONE)
+        {
+          /* Nowhere to keep the contents, so put the pages back,
+             still read-only if the frame is shared. */
+          for (q = p; q != NULL; q = q->next_sharer)
+            {
+              pagedir_set_page (q->pagedir, q->upage, p->kpage,
+                                q->writable && p->next_sharer == NULL);
+              pagedir_set_dirty (q->pagedir, q->upage, true);
+            }
+          evicted[dirty[i]] = false;
+          continue;
+        }
+      swap_write (s, p->kpage);
+      for (q = p; q != NULL; q = q->next_sharer)
+        {
+          if (q != p)
+            swap_dup (s);
+          q->swap_slot = s;
+          account_swap (q, 1);
+          account_swap_out (q);
+        }
+      written++;
+    }
+  return written;
+}
+
+/* Returns true if resident page P, or any page sharing its
+   frame, has been modified since it was brought in. */
+bool
+page_is_dirty (const struct page *p)
+{
+  for (; p != NULL; p = p->next_sharer)
+    if (pagedir_is_dirty (p->pagedir, p->upage))
+      return true;
+  return false;
+}
+
+/* Returns true if P has been accessed since the last call, and
+   clears its accessed bit.  Used by the replacement policy, which
+   is how we learn whether a page read ahead was wanted. */
+bool
+page_test_and_clear_accessed (struct page *p)
+{
+  if (!pagedir_is_accessed (p->pagedir, p->upage))
+    return false;
+  pagedir_set_accessed (p->pagedir, p->upage, false);
+  if (p->prefetched)
+    settle_prefetch (p, true);
+  return true;
+}
+
+/* Returns true if resident page P may share its frame with
+   other pages that happen to have the same contents: P must be
+   an ordinary writable page of memory, not part of a mapped file,
+   whose owner will get a copy of its own on the first write. */
+bool
+page_mergeable (const struct page *p)
+{
+  return p->writable && p->type != PAGE_MMAP
+         && p->prefetched == PREFETCH_NONE;
+}
+
+/* Makes resident page P read-only, so that the next write to it
+   faults and goes to page_copy_on_write(). */
+void
+page_write_protect (struct page *p)
+{
+  pagedir_set_writable (p->pagedir, p->upage, false);
+}
+
+/* Maps resident page P to frame KPAGE, which has the same
+   contents as its current frame, read-only.  Keeps P's dirty
+   bit, since it says whether the contents still match P's
+   file or must go to swap. */
+void
+page_remap (struct page *p, void *kpage)
+{
+  bool dirty = pagedir_is_dirty (p->pagedir, p->upage);
+
+  pagedir_clear_page (p->pagedir, p->upage);
+  pagedir_set_page (p->pagedir, p->upage, kpage, false);
+  pagedir_set_dirty (p->pagedir, p->upage, dirty);
+}
+
+/* Copies the counters in ACCT into ST.  Leaves the pid and name
+   in ST alone. */
+void
+page_get_stats (const struct page_acct *acct, struct procstat *st)
+{
+  st->minor_faults = acct->minor_faults;
+  st->major_faults = acct->major_faults;
+  st->swap_ins = acct->swap_ins;
+  st->swap_outs = acct->swap_outs;
+  st->swap_pages = acct->swap_cnt;
+  st->rss = acct->rss;
+  st->peak_rss = acct->peak_rss;
+  st->mmap_rss = acct->mmap_rss;
+}
+
+/* Prints supplemental page table statistics. */
+void
+page_print_stats (void)
+{
+  printf ("Read-ahead: %lld pages read ahead, %lld hits, %lld misses\n",
+          prefetch_cnt[PREFETCH_READ_AHEAD],
+          prefetch_hits[PREFETCH_READ_AHEAD],
+          prefetch_misses[PREFETCH_READ_AHEAD]);
+  printf ("Fault-around: %lld pages mapped, %lld faults avoided, "
+          "%lld unused\n",
+          prefetch_cnt[PREFETCH_FAULT_AROUND],
+          prefetch_hits[PREFETCH_FAULT_AROUND],
+          prefetch_misses[PREFETCH_FAULT_AROUND]);
+  printf ("madvise: %lld pages brought in, %lld hits, %lld misses, "
+          "%lld pages dropped\n",
+          prefetch_cnt[PREFETCH_WILLNEED], prefetch_hits[PREFETCH_WILLNEED],
+          prefetch_misses[PREFETCH_WILLNEED], dontneed_cnt);
+  printf ("Zero page: %lld pages mapped, %lld copied on write\n",
+          zero_map_cnt, zero_cow_cnt);
+  printf ("Pinning: %lld pages pinned for system calls, "
+          "%"PRId64" ticks spent bringing them in\n", pin_cnt, pin_ticks);
+  printf ("Fork: %lld pages shared, %lld copied on write, "
+          "%lld kept by the last sharer\n",
+          fork_share_cnt, fork_copy_cnt, fork_reuse_cnt);
+}
+
+/* Records whether page P, brought in early, was ACCESSED before
+   being evicted or freed. */
+static void
+settle_prefetch (struct page *p, bool accessed)
+{
+  if (accessed)
+    prefetch_hits[p->prefetched]++;
+  else
+    prefetch_misses[p->prefetched]++;
+  p->prefetched = PREFETCH_NONE;
+}
+
+/* Fills KPAGE with the initial contents of P.
+   Returns true if successful, false on a file read error. */
+static bool
+page_load (struct page *p, void *kpage)
+{
+  if (p->swap_slot != SWAP_NONE)
+    {
+      swap_read (p->swap_slot, kpage);
+      return true;
+    }
+  if (p->type != PAGE_ZERO)
+    {
+      bool acquired = lock_fs ();
+      off_t read = file_read_at (p->file, kpage, p->read_bytes, p->file_ofs);
+      unlock_fs (acquired);
+
+      if (read != (off_t) p->read_bytes)
+        return false;
+    }
+  memset ((uint8_t *) kpage + p->read_bytes, 0, PGSIZE - p->read_bytes);
+  return true;
+}
+
+/* Writes the contents of mapped file page P, in KPAGE, back to
+   its file. */
+static void
+write_back (struct page *p, const void *kpage)
+{
+  bool acquired = lock_fs ();
+  file_write_at (p->file, kpage, p->read_bytes, p->file_ofs);
+  unlock_fs (acquired);
+}
+
+/* Unmaps P and frees its frame, if it is resident, writing it
+   back first if it is a modified page of a mapped file. */
+static void
+release_page (struct page *p)
+{
+  void *kpage;
+
+  willneed_cancel (p);
+  if (p->zero_mapped)
+    {
+      pagedir_clear_page (p->pagedir, p->upage);
+      p->zero_mapped = false;
+      return;
+    }
+
+  kpage = frame_lock_page (p);
+
+  if (kpage != NULL)
+    {
+      pagedir_clear_page (p->pagedir, p->upage);
+      if (p->type == PAGE_MMAP && pagedir_is_dirty (p->pagedir, p->upage))
+        write_back (p, kpage);
+      if (p->prefetched)
+        settle_prefetch (p, pagedir_is_accessed (p->pagedir, p->upage));
+      frame_release_page (kpage, p);
+    }
+}
+
+/* Returns true if P's frame may be shared with other processes
+   that have the same page: P must be read-only text read from a
+   file.  Such a page is never modified, so every copy of it would
+   be the same. */
+static bool
+shareable (const struct page *p)
+{
+  return p->type == PAGE_FILE && !p->writable;
+}
+
+/* Acquires the file system lock, unless the current thread
+   already holds it.  read() and write() pin their buffers before
+   they take the lock, but a fault can still hit in the middle of
+   a system call that holds it, e.g. on a file name that crosses
+   into a page that has not been touched yet, and so can an
+   eviction that the fault causes.  Returns true if the lock was
+   acquired, which must be passed to unlock_fs(). */
+static bool
+lock_fs (void)
+{
+  if (lock_held_by_current_thread (&lock_filesys))
+    return false;
+  lock_acquire (&lock_filesys);
+  return true;
+}
+
+/* Releases the file system lock if ACQUIRED is true. */
+static void
+unlock_fs (bool acquired)
+{
+  if (acquired)
+    lock_release (&lock_filesys);
+}
+
+/* Returns a hash value for the page that E refers to. */
+static unsigned
+page_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct page *p = hash_entry (e, struct page, hash_elem);
+  return hash_bytes (&p->upage, sizeof p->upage);
+}
+
+/* Returns true if page A precedes page B in the order in which
+   page_out() assigns swap slots. */
+static bool
+page_precedes (const struct page *a, const struct page *b)
+{
+  return a->owner != b->owner ? a->owner < b->owner : a->upage < b->upage;
+}
+
+/* Returns true if page A precedes page B. */
+static bool
+page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct page *a = hash_entry (a_, struct page, hash_elem);
+  const struct page *b = hash_entry (b_, struct page, hash_elem);
+
+  return a->upage < b->upage;
+}
+
+/* Frees the page that E refers to, along with its swap slot. */
+static void
+page_free (struct hash_elem *e, void *aux UNUSED)
+{
+  struct page *p = hash_entry (e, struct page, hash_elem);
+
+  if (p->swap_slot != SWAP_NONE)
+    {
+      swap_free (p->swap_slot);
+      account_swap (p, -1);
+    }
+  free (p);
+}
+
+/* Adds DELTA to the count of swapped pages of P's owner, which
+   may be changed by any process that evicts one of its pages. */
+static void
+account_swap (struct page *p, int delta)
+{
+  enum intr_level old_level = intr_disable ();
+  p->owner->swap_cnt += delta;
+  intr_set_level (old_level);
+}
+
+/* Counts page P as written to swap, like account_swap(). */
+static void
+account_swap_out (struct page *p)
+{
+  enum intr_level old_level = intr_disable ();
+  p->owner->swap_outs++;
+  intr_set_level (old_level);
+}
+
+/* Counts page P as read back from swap, like account_swap(). */
+static void
+account_swap_in (struct page *p)
+{
+  enum intr_level old_level = intr_disable ();
+  p->owner->swap_ins++;
+  intr_set_level (old_level);
+}
+
+/* Queues page P of the current process for the prefetcher, unless
+   it is resident or is an untouched page of zeros, which costs
+   nothing to fault in later.  The prefetcher checks again, since
+   P may be evicted or brought in before it gets to P. */
+static void
+willneed_queue (struct page *p)
+{
+  if (!prefetcher_running || p->zero_mapped || p->kpage != NULL
+      || (p->type == PAGE_ZERO && p->swap_slot == SWAP_NONE))
+    return;
+
+  lock_acquire (&willneed_lock);
+  if (!p->willneed)
+    {
+      p->willneed = true;
+      list_push_back (&willneed_pages, &p->willneed_elem);
+      cond_signal (&willneed_ready, &willneed_lock);
+    }
+  lock_release (&willneed_lock);
+}
+
+/* Takes page P off the prefetcher's queue, or waits for the
+   prefetcher to finish with it, so that P's owner may use it.
+   Called by P's owner, or by the reaper after the owner exits,
+   so P cannot be queued again behind our back. */
+static void
+willneed_cancel (struct page *p)
+{
+  /* Only the owner sets `willneed', so a false value is
+     current. */
+  if (!p->willneed)
+    return;
+
+  lock_acquire (&willneed_lock);
+  if (p->willneed && p != willneed_busy)
+    {
+      list_remove (&p->willneed_elem);
+      p->willneed = false;
+    }
+  while (p->willneed)
+    cond_wait (&willneed_done, &willneed_lock);
+  lock_release (&willneed_lock);
+}
+
+/* Prefetcher thread.  See the comment on willneed_pages. */
+static void
+prefetcher (void *aux UNUSED)
+{
+  lock_acquire (&willneed_lock);
+  for (;;)
+    {
+      struct page *p;
+
+      while (list_empty (&willneed_pages))
+        cond_wait (&willneed_ready, &willneed_lock);
+      p = list_entry (list_pop_front (&willneed_pages),
+                      struct page, willneed_elem);
+      willneed_busy = p;
+      lock_release (&willneed_lock);
+
+      prefetch (p);
+
+      lock_acquire (&willneed_lock);
+      willneed_busy = NULL;
+      p->willneed = false;
+      cond_broadcast (&willneed_done, &willneed_lock);
+    }
+}
+
+/* Brings in page P for the prefetcher, unless it is resident or
+   may be mapped to the zero page.  P's owner may be in a system
+   call that holds the file system lock and be waiting for P in
+   willneed_cancel(), so a page that must be read from its file
+   is skipped if that lock is taken, instead of waiting for it. */
+static void
+prefetch (struct page *p)
+{
+  bool fs_locked = false;
+
+  if (p->zero_mapped || frame_wait (p) || maps_zero_page (p))
+    return;
+  if (p->swap_slot == SWAP_NONE && p->type != PAGE_ZERO)
+    {
+      if (!lock_try_acquire (&lock_filesys))
+        return;
+      fs_locked = true;
+    }
+  bring_in (p, PREFETCH_WILLNEED);
+  if (fs_locked)
+    lock_release (&lock_filesys);
+}
@@ -0,0 +1,135 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <procstat.h>
+#include "filesys/off_t.h"
+#include "vm/swap.h"
+
+/* Where the contents of a page come from the first time it is
+   touched. */
+enum page_type
+  {
+    PAGE_FILE,                  /* Read from a file, zero the rest. */
+    PAGE_ZERO,                  /* All zeros. */
+    PAGE_MMAP                   /* Mapped file, written back to it. */
+  };
+
+/* Why a page was brought in before it was touched. */
+enum page_prefetch
+  {
+    PREFETCH_NONE,              /* It wasn't, or it has been touched. */
+    PREFETCH_READ_AHEAD,        /* Read ahead from swap. */
+    PREFETCH_FAULT_AROUND,      /* Mapped around a faulting page. */
+    PREFETCH_WILLNEED,          /* Asked for with MADV_WILLNEED. */
+    PREFETCH_CNT                /* Number of values. */
+  };
+
+/* Advice given to madvise() about a range of pages.  The first
+   three describe how the range will be accessed and stick to its
+   pages; the others act on the pages once, when given. */
+enum page_advice
+  {
+    MADV_NORMAL,                /* No special treatment. */
+    MADV_RANDOM,                /* Random access: no fault-around. */
+    MADV_SEQUENTIAL,            /* Sequential: bring in far ahead. */
+    MADV_WILLNEED,              /* Needed soon: prefetch. */
+    MADV_DONTNEED               /* Not needed: drop now. */
+  };
+
+/* Per-process memory accounting.
+
+   Kept apart from the process's struct thread, because the pages
+   of an exited process are freed later by the reaper thread (see
+   userprog/process.c), after the struct thread is gone. */
+struct page_acct
+  {
+    /* Updated with interrupts off, by any process that swaps
+       one of the pages in or out, or by the prefetcher. */
+    size_t swap_cnt;            /* Number of pages in swap. */
+    unsigned swap_outs;         /* Pages written to swap. */
+    unsigned swap_ins;          /* Pages read back from swap. */
+
+    /* Protected by the frame table's lock. */
+    size_t rss;                 /* Pages in frames. */
+    size_t peak_rss;            /* Most pages ever in frames. */
+    size_t mmap_rss;            /* Pages of mapped files in frames. */
+
+    /* Owning process only. */
+    unsigned minor_faults;      /* Faults served without I/O. */
+    unsigned major_faults;      /* Faults that read a file or swap. */
+  };
+
+/* Supplemental page table entry.
+
+   Each process has a hash table of these in its struct thread,
+   keyed by user virtual page, describing every page of its
+   address space whether or not the page is currently in a
+   frame.  The page fault handler uses it to bring pages in on
+   first touch, and again after eviction, from swap if the page
+   was modified or from its original source otherwise. */
+struct page
+  {
+    struct hash_elem hash_elem; /* Element in thread's `pages'. */
+    void *upage;                /* User virtual address. */
+    struct page_acct *owner;    /* Owning process's accounting. */
+    uint32_t *pagedir;          /* Owning process's page directory. */
+    bool writable;              /* Mapped read/write? */
+    enum page_type type;        /* Origin of the page's contents. */
+
+    /* Protected by the frame table's lock; see vm/frame.c. */
+    void *kpage;                /* Kernel address of frame, or null. */
+    struct page *next_sharer;   /* Next page sharing the frame. */
+    bool evicted;               /* Ever evicted from a frame? */
+    swap_slot_t swap_slot;      /* Slot holding contents, or SWAP_NONE. */
+    enum page_prefetch prefetched; /* Brought in early, not accessed? */
+
+    /* Owning process only, except while `willneed' is true. */
+    bool zero_mapped;           /* Mapped read-only to the zero page? */
+    enum page_advice advice;    /* MADV_NORMAL, _RANDOM or _SEQUENTIAL. */
+
+    /* Protected by the prefetcher's lock; see page_advise(). */
+    bool willneed;              /* Queued for, or held by, prefetcher? */
+    struct list_elem willneed_elem; /* Element in prefetcher's queue. */
+
+    /* PAGE_FILE and PAGE_MMAP only. */
+    struct file *file;          /* File to read from. */
+    off_t file_ofs;             /* Offset in FILE. */
+    uint32_t read_bytes;        /* Bytes to read; the rest is zeroed. */
+  };
+
+struct thread;
+
+void page_init (void);
+void page_start_prefetcher (void);
+bool page_table_init (struct thread *);
+void page_table_destroy (struct hash *, struct page_acct *);
+bool page_table_copy (struct thread *parent, struct file *);
+
+bool page_add_file (void *upage, struct file *, off_t ofs,
+                    uint32_t read_bytes, bool writable);
+bool page_add_mmap (void *upage, struct file *, off_t ofs,
+                    uint32_t read_bytes);
+void page_remove (void *upage);
+struct page *page_lookup (struct hash *, const void *upage);
+bool page_in (void *upage, bool write);
+bool page_copy_on_write (void *upage);
+bool page_grow_stack (const void *fault_addr, const void *esp);
+bool page_pin (const void *uaddr, bool write);
+void page_unpin (const void *uaddr);
+void page_set_stack_limit (size_t bytes);
+void page_set_fault_around (size_t n);
+bool page_advise (void *addr, size_t len, enum page_advice);
+size_t page_out (struct page *[], size_t cnt, bool evicted[]);
+bool page_is_dirty (const struct page *);
+bool page_test_and_clear_accessed (struct page *);
+bool page_mergeable (const struct page *);
+void page_write_protect (struct page *);
+void page_remap (struct page *, void *kpage);
+void page_get_stats (const struct page_acct *, struct procstat *);
+void page_print_stats (void);
+
+#endif /* vm/page.h */
@@ -0,0 +1,174 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <stdio.h>
+#include "devices/block.h"
+#include "devices/timer.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "vm/zswap.h"
+
+/* Swap space.
+
+   The BLOCK_SWAP device is divided into page-sized slots of
+   SECTORS_PER_SLOT consecutive sectors each, and a bitmap
+   records which slots are in use.  Slots are handed out in
+   contiguous runs, so that pages evicted together are written
+   to consecutive sectors.
+
+   Pages written to a slot may be kept compressed in memory by
+   the swap cache in vm/zswap.c instead of going to disk.
+
+   A slot may hold the contents of several pages at once, the
+   copies of a page that fork() left shared between processes,
+   so each slot has a count of the pages that refer to it, and is
+   released only when the last of them lets go.
+
+   If there is no swap device, there are no slots, and every
+   swap_alloc() fails. */
+
+/* Sectors per page-sized slot. */
+#define SECTORS_PER_SLOT (PGSIZE / BLOCK_SECTOR_SIZE)
+
+static struct block *swap_device;       /* Swap device, or null. */
+static struct bitmap *used_slots;       /* In-use slots. */
+static uint16_t *slot_refs;             /* Pages referring to each slot. */
+static struct lock swap_lock;           /* Protects the above. */
+
+/* Statistics. */
+static long long swap_in_cnt;           /* # of pages read from swap. */
+static long long swap_out_cnt;          /* # of pages written to swap. */
+static long long cluster_cnt;           /* # of runs allocated. */
+
+/* Sets up swap space on the BLOCK_SWAP device, if there is one. */
+void
+swap_init (void)
+{
+  size_t slot_cnt = 0;
+
+  lock_init (&swap_lock);
+  swap_device = block_get_role (BLOCK_SWAP);
+  if (swap_device != NULL)
+    slot_cnt = block_size (swap_device) / SECTORS_PER_SLOT;
+
+  used_slots = bitmap_create (slot_cnt);
+  slot_refs = calloc (slot_cnt, sizeof *slot_refs);
+  if (used_slots == NULL || (slot_refs == NULL && slot_cnt > 0))
+    PANIC ("swap_init: cannot allocate slot bitmap");
+  zswap_init (slot_cnt);
+
+  if (swap_device != NULL)
+    printf ("swap: %zu page slots on %s\n",
+            slot_cnt, block_name (swap_device));
+  else
+    printf ("swap: no swap device, swapping disabled\n");
+}
+
+/* Allocates CNT consecutive free slots and returns the first, or
+   SWAP_NONE if there is no run that long.  Each slot starts out
+   with one reference. */
+swap_slot_t
+swap_alloc (size_t cnt)
+{
+  size_t slot;
+  size_t i;
+
+  ASSERT (cnt > 0);
+
+  lock_acquire (&swap_lock);
+  slot = bitmap_scan_and_flip (used_slots, 0, cnt, false);
+  if (slot != BITMAP_ERROR)
+    {
+      cluster_cnt++;
+      for (i = 0; i < cnt; i++)
+        slot_refs[slot + i] = 1;
+    }
+  lock_release (&swap_lock);
+
+  return slot != BITMAP_ERROR ? slot : SWAP_NONE;
+}
+
+/* Adds a reference to SLOT, which must be in use, for another
+   page that shares its contents. */
+void
+swap_dup (swap_slot_t slot)
+{
+  lock_acquire (&swap_lock);
+  ASSERT (bitmap_test (used_slots, slot));
+  ASSERT (slot_refs[slot] < UINT16_MAX);
+  slot_refs[slot]++;
+  lock_release (&swap_lock);
+}
+
+/* Drops a reference to SLOT, which must be in use, and releases
+   it if that was the last one. */
+void
+swap_free (swap_slot_t slot)
+{
+  lock_acquire (&swap_lock);
+  ASSERT (bitmap_test (used_slots, slot));
+  if (--slot_refs[slot] == 0)
+    {
+      /* Drop the compressed copy before the slot can be reused. */
+      zswap_drop (slot);
+      bitmap_reset (used_slots, slot);
+    }
+  lock_release (&swap_lock);
+}
+
+/* Writes the page at KPAGE to SLOT. */
+void
+swap_write (swap_slot_t slot, const void *kpage)
+{
+  block_sector_t sector = slot * SECTORS_PER_SLOT;
+  size_t i;
+
+  ASSERT (bitmap_test (used_slots, slot));
+
+  if (!zswap_store (slot, kpage))
+    for (i = 0; i < SECTORS_PER_SLOT; i++)
+      block_write (swap_device, sector + i,
+                   (const uint8_t *) kpage + i * BLOCK_SECTOR_SIZE);
+
+  lock_acquire (&swap_lock);
+  swap_out_cnt++;
+  lock_release (&swap_lock);
+}
+
+/* Reads SLOT into the page at KPAGE. */
+void
+swap_read (swap_slot_t slot, void *kpage)
+{
+  block_sector_t sector = slot * SECTORS_PER_SLOT;
+  size_t i;
+
+  ASSERT (bitmap_test (used_slots, slot));
+
+  if (!zswap_load (slot, kpage))
+    for (i = 0; i < SECTORS_PER_SLOT; i++)
+      block_read (swap_device, sector + i,
+                  (uint8_t *) kpage + i * BLOCK_SECTOR_SIZE);
+
+  lock_acquire (&swap_lock);
+  swap_in_cnt++;
+  lock_release (&swap_lock);
+}
+
+/* Prints swap statistics. */
+void
+swap_print_stats (void)
+{
+  int64_t secs = timer_ticks () / TIMER_FREQ;
+
+  if (used_slots == NULL)
+    return;
+  if (secs < 1)
+    secs = 1;
+  printf ("Swap: %zu of %zu slots in use, %lld pages in, %lld pages out "
+          "in %lld runs\n",
+          bitmap_count (used_slots, 0, bitmap_size (used_slots), true),
+          bitmap_size (used_slots), swap_in_cnt, swap_out_cnt, cluster_cnt);
+  printf ("Swap: %lld pages/s in, %lld pages/s out\n",
+          swap_in_cnt / secs, swap_out_cnt / secs);
+}
@@ -0,0 +1,25 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Swap slot index. */
+typedef size_t swap_slot_t;
+
+/* Returned by swap_alloc() when no slots are free, and used as
+   a page's slot when it is not in swap. */
+#define SWAP_NONE SIZE_MAX
+
+/* Most pages written to swap as one contiguous run of slots. */
+#define SWAP_CLUSTER 8
+
+void swap_init (void);
+swap_slot_t swap_alloc (size_t cnt);
+void swap_dup (swap_slot_t);
+void swap_free (swap_slot_t);
+void swap_write (swap_slot_t, const void *kpage);
+void swap_read (swap_slot_t, void *kpage);
+void swap_print_stats (void);
+
+#endif /* vm/swap.h */
@@ -0,0 +1,218 @@
+#include "vm/zswap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <lz.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Compressed swap cache.
+
+   Sits in front of the swap device.  A page written to a swap
+   slot is first compressed, and if it shrinks to at most
+   ZSWAP_MAX_SIZE bytes and there is room, it is kept in an
+   in-memory pool instead of being written to disk.  Reading the
+   slot back then decompresses straight into the destination
+   frame, without any disk I/O.  The slot on disk stays
+   allocated, so that a page can always fall back to it, and so
+   that swap slot numbers mean the same thing either way.
+
+   The pool is a fixed block of kernel pages, divided into
+   ZSWAP_CHUNK-byte chunks.  A compressed page occupies a run of
+   consecutive chunks, found with a bitmap. */
+
+/* Pool allocation unit, in bytes. */
+#define ZSWAP_CHUNK 64
+
+/* Largest compressed page worth keeping.  Pages that compress
+   worse than this go to disk. */
+#define ZSWAP_MAX_SIZE (PGSIZE * 3 / 4)
+
+/* Default pool size, in pages. */
+#define ZSWAP_DEFAULT_PAGES 32
+
+/* Largest pool, in pages, so that chunk numbers fit in 16 bits. */
+#define ZSWAP_MAX_PAGES (UINT16_MAX * ZSWAP_CHUNK / PGSIZE)
+
+/* Where a slot's contents are in the pool. */
+struct zswap_entry
+  {
+    uint16_t chunk;             /* First chunk. */
+    uint16_t size;              /* Compressed size, 0 if not cached. */
+  };
+
+static size_t pool_pages = ZSWAP_DEFAULT_PAGES; /* -zswap option. */
+static uint8_t *pool;                   /* Pool, or null if disabled. */
+static struct bitmap *used_chunks;      /* Chunks in use. */
+static struct zswap_entry *entries;     /* One per swap slot. */
+static size_t entry_cnt;                /* Number of swap slots. */
+
+/* Protects all of the above, and the compression scratch
+   space. */
+static struct lock zswap_lock;
+
+/* Compression scratch space. */
+static uint8_t zbuf[ZSWAP_MAX_SIZE];
+static uint16_t ztable[LZ_TABLE_SIZE];
+
+/* Statistics. */
+static long long store_cnt;             /* # of pages stored. */
+static long long reject_cnt;            /* # that compressed poorly. */
+static long long spill_cnt;             /* # that didn't fit the pool. */
+static long long load_cnt;              /* # of slot reads. */
+static long long hit_cnt;               /* # found in the pool. */
+static long long orig_bytes;            /* Uncompressed bytes stored. */
+static long long comp_bytes;            /* Compressed bytes stored. */
+
+static void drop (struct zswap_entry *);
+static size_t chunks (size_t size);
+
+/* Sets the pool size to PAGES pages.  0 disables the cache.
+   Must be called before zswap_init(). */
+void
+zswap_set_size (size_t pages)
+{
+  pool_pages = pages < ZSWAP_MAX_PAGES ? pages : ZSWAP_MAX_PAGES;
+}
+
+/* Sets up the cache for a swap device with SLOT_CNT slots. */
+void
+zswap_init (size_t slot_cnt)
+{
+  lock_init (&zswap_lock);
+  if (pool_pages == 0 || slot_cnt == 0)
+    return;
+
+  pool = palloc_get_multiple (0, pool_pages);
+  used_chunks = bitmap_create (pool_pages * PGSIZE / ZSWAP_CHUNK);
+  entries = calloc (slot_cnt, sizeof *entries);
+  if (pool == NULL || used_chunks == NULL || entries == NULL)
+    {
+      printf ("zswap: cannot allocate %zu-page pool, disabled\n",
+              pool_pages);
+      if (pool != NULL)
+        palloc_free_multiple (pool, pool_pages);
+      if (used_chunks != NULL)
+        bitmap_destroy (used_chunks);
+      free (entries);
+      pool = NULL;
+      return;
+    }
+  entry_cnt = slot_cnt;
+  printf ("zswap: %zu-page compressed swap cache\n", pool_pages);
+}
+
+/* Tries to keep a compressed copy of the page at KPAGE as the
+   contents of SLOT.  Returns true if successful, false if the
+   page must be written to disk. */
+bool
+zswap_store (swap_slot_t slot, const void *kpage)
+{
+  size_t size, chunk;
+  bool stored = false;
+
+  if (pool == NULL)
+    return false;
+  ASSERT (slot < entry_cnt);
+
+  lock_acquire (&zswap_lock);
+  ASSERT (entries[slot].size == 0);
+  size = lz_compress (kpage, PGSIZE, zbuf, sizeof zbuf, ztable);
+  if (size == 0)
+    reject_cnt++;
+  else
+    {
+      chunk = bitmap_scan_and_flip (used_chunks, 0, chunks (size), false);
+      if (chunk == BITMAP_ERROR)
+        spill_cnt++;
+      else
+        {
+          memcpy (pool + chunk * ZSWAP_CHUNK, zbuf, size);
+          entries[slot].chunk = chunk;
+          entries[slot].size = size;
+          store_cnt++;
+          orig_bytes += PGSIZE;
+          comp_bytes += size;
+          stored = true;
+        }
+    }
+  lock_release (&zswap_lock);
+
+  return stored;
+}
+
+/* If SLOT's contents are in the cache, decompresses them into
+   KPAGE and returns true.  Otherwise returns false.  The cached
+   copy stays until the slot is freed. */
+bool
+zswap_load (swap_slot_t slot, void *kpage)
+{
+  bool hit;
+
+  if (pool == NULL)
+    return false;
+
+  lock_acquire (&zswap_lock);
+  load_cnt++;
+  hit = entries[slot].size != 0;
+  if (hit)
+    {
+      struct zswap_entry *e = &entries[slot];
+
+      if (lz_decompress (pool + e->chunk * ZSWAP_CHUNK, e->size,
+                         kpage, PGSIZE) != PGSIZE)
+        PANIC ("zswap: slot %zu is corrupt", slot);
+      hit_cnt++;
+    }
+  lock_release (&zswap_lock);
+
+  return hit;
+}
+
+/* Drops SLOT's contents from the cache, if they are there. */
+void
+zswap_drop (swap_slot_t slot)
+{
+  if (pool == NULL)
+    return;
+
+  lock_acquire (&zswap_lock);
+  drop (&entries[slot]);
+  lock_release (&zswap_lock);
+}
+
+/* Prints compressed swap cache statistics. */
+void
+zswap_print_stats (void)
+{
+  if (pool == NULL)
+    return;
+  printf ("Zswap: %lld pages stored at %lld%% of original size, "
+          "%lld compressed poorly, %lld spilled to disk\n",
+          store_cnt, orig_bytes > 0 ? comp_bytes * 100 / orig_bytes : 0,
+          reject_cnt, spill_cnt);
+  printf ("Zswap: %lld of %lld reads hit the pool (%lld%%)\n",
+          hit_cnt, load_cnt, load_cnt > 0 ? hit_cnt * 100 / load_cnt : 0);
+}
+
+/* Frees E's chunks, if it has any.  zswap_lock must be held. */
+static void
+drop (struct zswap_entry *e)
+{
+  if (e->size != 0)
+    {
+      bitmap_set_multiple (used_chunks, e->chunk, chunks (e->size), false);
+      e->size = 0;
+    }
+}
+
+/* Returns the number of chunks needed for SIZE bytes. */
+static size_t
+chunks (size_t size)
+{
+  return DIV_ROUND_UP (size, ZSWAP_CHUNK);
+}
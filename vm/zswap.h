@@ -0,0 +1,15 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "vm/swap.h"
+
+void zswap_set_size (size_t pages);
+void zswap_init (size_t slot_cnt);
+bool zswap_store (swap_slot_t, const void *kpage);
+bool zswap_load (swap_slot_t, void *kpage);
+void zswap_drop (swap_slot_t);
+void zswap_print_stats (void);
+
+#endif /* vm/zswap.h */